@@ -0,0 +1,130 @@
+﻿# Measure-Features.ps1：按功能组合分别编译 Release|x64 DLL，报告 DLL 大小与启动耗时
+#
+# 在 VS 开发者 PowerShell 中运行（msbuild 需在 PATH 中，NuGet 包需已还原）：
+#   powershell -ExecutionPolicy Bypass -File SMTC-Bridge-Cpp\Measure-Features.ps1 [-Runs 5]
+# 组合为：全开、逐个关闭一项、全关。每个组合编译到 $OutRoot 下的独立目录。
+# 启动耗时在新的进程中测量（避免复用已加载的 DLL 和 WinRT 工厂），取 Runs 次的中位数：
+#   load        LoadLibrary 耗时
+#   first title InitSMTC 到 SMTC_GetTitle 返回非空；需要有正在播放的媒体，否则记为超时
+#   stop        ShutdownSMTC 耗时
+
+param(
+    [int]$Runs = 5,
+    [int]$TimeoutMs = 5000,
+    [string]$OutRoot = (Join-Path $env:TEMP 'smtc-feature-builds')
+)
+$ErrorActionPreference = 'Stop'
+
+$project = Join-Path $PSScriptRoot 'SMTC-Bridge-Cpp.vcxproj'
+$features = @('SMTC_FEATURE_COVER', 'SMTC_FEATURE_SESSION_VOLUME', 'SMTC_FEATURE_MASTER_VOLUME', 'SMTC_FEATURE_CONTROLS')
+
+$combos = @(, @(1, 1, 1, 1))
+for ($i = 0; $i -lt $features.Count; $i++) {
+    $combo = @(1, 1, 1, 1)
+    $combo[$i] = 0
+    $combos += , $combo
+}
+$combos += , @(0, 0, 0, 0)
+
+$probeSource = @'
+using System;
+using System.Diagnostics;
+using System.Globalization;
+using System.Runtime.InteropServices;
+using System.Threading;
+
+public static class SmtcProbe {
+    [DllImport("kernel32", SetLastError = true, CharSet = CharSet.Unicode)]
+    static extern IntPtr LoadLibraryW(string path);
+    [DllImport("kernel32", CharSet = CharSet.Ansi)]
+    static extern IntPtr GetProcAddress(IntPtr module, string name);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)] delegate void VoidFn();
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)] delegate int GetTitleFn(byte[] buffer, int len);
+
+    static T Export<T>(IntPtr module, string name) where T : class {
+        IntPtr p = GetProcAddress(module, name);
+        if (p == IntPtr.Zero) throw new Exception("missing export " + name);
+        return Marshal.GetDelegateForFunctionPointer(p, typeof(T)) as T;
+    }
+
+    // 返回 "load;first;stop"（毫秒），first 为 -1 表示超时
+    public static string Run(string dll, int timeoutMs) {
+        var sw = Stopwatch.StartNew();
+        IntPtr module = LoadLibraryW(dll);
+        if (module == IntPtr.Zero) throw new Exception("LoadLibrary failed: " + Marshal.GetLastWin32Error());
+        double load = sw.Elapsed.TotalMilliseconds;
+
+        var init = Export<VoidFn>(module, "InitSMTC");
+        var shutdown = Export<VoidFn>(module, "ShutdownSMTC");
+        var getTitle = Export<GetTitleFn>(module, "SMTC_GetTitle");
+        var buffer = new byte[512];
+
+        sw.Restart();
+        init();
+        double first = -1;
+        while (sw.ElapsedMilliseconds < timeoutMs) {
+            if (getTitle(buffer, buffer.Length) > 0) { first = sw.Elapsed.TotalMilliseconds; break; }
+            Thread.Sleep(1);
+        }
+
+        sw.Restart();
+        shutdown();
+        double stop = sw.Elapsed.TotalMilliseconds;
+        return string.Format(CultureInfo.InvariantCulture, "{0:F2};{1:F2};{2:F2}", load, first, stop);
+    }
+}
+'@
+
+function Get-Median([double[]]$values) {
+    $valid = @($values | Where-Object { $_ -ge 0 } | Sort-Object)
+    if ($valid.Count -eq 0) { return 'timeout' }
+    return '{0:F1}' -f $valid[[int][math]::Floor(($valid.Count - 1) / 2)]
+}
+
+New-Item -ItemType Directory -Force -Path $OutRoot | Out-Null
+$probePath = Join-Path $OutRoot 'SmtcProbe.cs'
+Set-Content -Path $probePath -Value $probeSource -Encoding UTF8
+
+$rows = @()
+foreach ($combo in $combos) {
+    $defines = @()
+    $disabled = @()
+    for ($i = 0; $i -lt $features.Count; $i++) {
+        $defines += "/D$($features[$i])=$($combo[$i])"
+        if ($combo[$i] -eq 0) { $disabled += $features[$i].Replace('SMTC_FEATURE_', '') }
+    }
+    $name = if ($disabled.Count -eq 0) { 'all-on' } elseif ($disabled.Count -eq $features.Count) { 'all-off' } else { 'no-' + ($disabled -join '-').ToLower() }
+
+    # 定义通过 CL 环境变量传给编译器，不必改工程文件；OutDir/IntDir 用正斜杠结尾，避免反斜杠转义掉引号
+    $out = Join-Path $OutRoot $name
+    $env:CL = $defines -join ' '
+    try {
+        & msbuild $project /nologo /v:minimal /t:Rebuild /p:Configuration=Release /p:Platform=x64 "/p:OutDir=$out/" "/p:IntDir=$out/obj/"
+    }
+    finally {
+        Remove-Item Env:CL -ErrorAction SilentlyContinue
+    }
+    if ($LASTEXITCODE -ne 0) { throw "build failed: $name" }
+    $dll = Get-ChildItem -Path $out -Filter *.dll | Select-Object -First 1
+
+    $load = @(); $first = @(); $stop = @()
+    for ($run = 0; $run -lt $Runs; $run++) {
+        $result = & powershell -NoProfile -ExecutionPolicy Bypass -Command "Add-Type -Path '$probePath'; [SmtcProbe]::Run('$($dll.FullName)', $TimeoutMs)"
+        if ($LASTEXITCODE -ne 0) { throw "probe failed: $name" }
+        $parts = "$result".Trim().Split(';')
+        $load += [double]::Parse($parts[0], [Globalization.CultureInfo]::InvariantCulture)
+        $first += [double]::Parse($parts[1], [Globalization.CultureInfo]::InvariantCulture)
+        $stop += [double]::Parse($parts[2], [Globalization.CultureInfo]::InvariantCulture)
+    }
+
+    $rows += [pscustomobject]@{
+        Build            = $name
+        'DLL KB'         = [math]::Round($dll.Length / 1KB, 1)
+        'load ms'        = Get-Median $load
+        'first title ms' = Get-Median $first
+        'stop ms'        = Get-Median $stop
+    }
+}
+
+$rows | Format-Table -AutoSize
@@ -1,4 +1,39 @@
 // SafeSMTC.cpp  ¼ȫ汾 C# ص
+
+// ================= ƽ̨ =================
+// ʽֻ WindowsWinRT ýˡCore Audio ܵ IPC
+// ƽֻ̨벻ϵͳ˵ĺģѹ Linux  sanitizer У SMTC-Bridge-Stress/CMakeLists.txt
+// ûĬýˣע룩ܲãIPC ķ񲻿á
+#ifdef _WIN32
+#define SMTC_PLATFORM_WINDOWS 1
+#define SMTC_API extern "C" __declspec(dllexport)
+#define SMTC_CALL __stdcall
+#else
+#define SMTC_PLATFORM_WINDOWS 0
+#define SMTC_API extern "C" __attribute__((visibility("default")))
+#define SMTC_CALL
+#endif
+
+// ================= ڹѡ =================
+// ͨԤüҪĹܣĿм SMTC_FEATURE_COVER=0
+// رյĹܲӦĴ롢ͷļ͵ӿڣWorker  UpdateMediaProperties Ҳʱжϡ
+// ṹĲֲñ仯üܶӦֶαΪ 0SMTC_GetFeatures ʵʱĹܡ
+#ifndef SMTC_FEATURE_COVER
+#define SMTC_FEATURE_COVER 1          // ȡ뻺桢SMTC_GetCoverImage
+#endif
+#ifndef SMTC_FEATURE_SESSION_VOLUME
+#define SMTC_FEATURE_SESSION_VOLUME SMTC_PLATFORM_WINDOWS // ƵỰƥ䡢䣩
+#endif
+#ifndef SMTC_FEATURE_MASTER_VOLUME
+#define SMTC_FEATURE_MASTER_VOLUME SMTC_PLATFORM_WINDOWS  // ϵͳĬ豸
+#endif
+#ifndef SMTC_FEATURE_CONTROLS
+#define SMTC_FEATURE_CONTROLS 1       // ſ/ͣ/и/ת
+#endif
+#if !SMTC_PLATFORM_WINDOWS && (SMTC_FEATURE_SESSION_VOLUME || SMTC_FEATURE_MASTER_VOLUME)
+#error "SMTC_FEATURE_SESSION_VOLUME / SMTC_FEATURE_MASTER_VOLUME need Core Audio (Windows only)"
+#endif
+
 #include <string>
 #include <vector>
 #include <mutex>
@@ -7,50 +42,60 @@
 #include <iostream>
 #include <algorithm>
 #include <queue>
+#include <unordered_map>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
+#include <memory>
+#include <deque>
+#include <coroutine>
+#include <optional>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#if SMTC_PLATFORM_WINDOWS
 #include <windows.h>
 // ... (ԭе WinRT  Core Audio ͷļ) ...
 #include <winrt/Windows.Foundation.h>
 #include <winrt/Windows.Foundation.Collections.h>
 #include <winrt/Windows.Media.Control.h>
+#if SMTC_FEATURE_COVER
 #include <winrt/Windows.Storage.Streams.h>
+#endif
+#if SMTC_FEATURE_SESSION_VOLUME || SMTC_FEATURE_MASTER_VOLUME
 #include <mmdeviceapi.h>
+#endif
+#if SMTC_FEATURE_MASTER_VOLUME
 #include <endpointvolume.h>
+#endif
+#if SMTC_FEATURE_SESSION_VOLUME
 #include <audiopolicy.h>  //  IAudioSessionManager2, IAudioSessionControl 
-#include <Psapi.h>        //  GetProcessImageFileNameW
+#endif
+#include <Psapi.h>        //  GetProcessMemoryInfo
+#include <sddl.h>         // IPC ܵİȫ
 #pragma comment(lib, "Ole32.lib")
+#pragma comment(lib, "Psapi.lib")
+#pragma comment(lib, "Advapi32.lib")
 
 using namespace winrt;
 using namespace Windows::Media::Control;
+#if SMTC_FEATURE_COVER
 using namespace Windows::Storage::Streams;
+#endif
 using namespace Windows::Foundation;
-
-// ================= ȫֿƱ =================
-// ... ( g_isRunning, g_workerThread, g_dataMutex, g_title, g_artist, ...) ...
-static std::atomic<bool> g_isRunning{ false };
-static std::thread g_workerThread;
-static std::mutex g_dataMutex;
-static std::string g_title;
-static std::string g_artist;
-static std::vector<uint8_t> g_coverBuffer;
-static int64_t g_positionTicks = 0;
-static int64_t g_durationTicks = 0;
-static bool g_isPlaying = false;
-static bool g_hasNewCover = false;
-static std::atomic<bool> g_isDataDirty{ false }; // Ƿ仯
-
-// ... ( WinRT  g_manager, g_currentSession, tokens, е) ...
-static GlobalSystemMediaTransportControlsSessionManager g_manager = nullptr;
-static GlobalSystemMediaTransportControlsSession g_currentSession = nullptr;
-static winrt::event_token g_sessionChangedToken{};
-static winrt::event_token g_mediaPropertiesToken{};
-static winrt::event_token g_timelinePropertiesToken{};
-static winrt::event_token g_playbackInfoToken{};
-static std::mutex g_queueMutex;
-static std::condition_variable g_queueCv;
-static std::queue<std::function<void()>> g_taskQueue;
-static bool g_isChangingSession = false;
+#else
+#include <fstream>        // /proc/self/status
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
 
 // ================= C# صӿڶ =================
 // ¼ͣ0=ý(Title/Artist/Cover), 1=ʱ(Position/Duration), 2=״̬(Playing)
@@ -61,11 +106,521 @@ enum SMTC_EventType {
     SessionChanged = 3 // ڲʹãԱ¶ C#
 };
 
+struct SMTC_Context;
+
 // C# صָͣݱ仯ʱ
 // ע⣺ص C++ worker ߳еõģC# Ҫȷ̰߳ȫ
-using SMTC_UpdateCallback = void(__stdcall*)(SMTC_EventType eventType);
-static SMTC_UpdateCallback g_externalCallback = nullptr;
+using SMTC_UpdateCallback = void(SMTC_CALL*)(SMTC_EventType eventType);
+// Ļصϴ¼ľעʱ userDataڶķԴ
+using SMTC_ContextCallback = void(SMTC_CALL*)(SMTC_Context* context, SMTC_EventType eventType, void* userData);
+
+// SMTC_GetFeatures صĹλ
+enum SMTC_Feature : uint32_t {
+    SMTC_Feature_Cover = 1u << 0,
+    SMTC_Feature_SessionVolume = 1u << 1,
+    SMTC_Feature_MasterVolume = 1u << 2,
+    SMTC_Feature_Controls = 1u << 3
+};
+static constexpr uint32_t kCompiledFeatures =
+    (SMTC_FEATURE_COVER ? SMTC_Feature_Cover : 0u) |
+    (SMTC_FEATURE_SESSION_VOLUME ? SMTC_Feature_SessionVolume : 0u) |
+    (SMTC_FEATURE_MASTER_VOLUME ? SMTC_Feature_MasterVolume : 0u) |
+    (SMTC_FEATURE_CONTROLS ? SMTC_Feature_Controls : 0u);
+
+// ================= չԪ =================
+// SMTC_GetMediaInfo һηȫֶΣ 64 λ sinceVersion 仯ֶΡ
+// ֻеֶλᱻд룬÷Ӧڶε֮临ͬһṹ塣
+enum SMTC_Field {
+    SMTC_Field_Title = 0,
+    SMTC_Field_Artist = 1,
+    SMTC_Field_AlbumTitle = 2,
+    SMTC_Field_AlbumArtist = 3,
+    SMTC_Field_TrackNumber = 4,
+    SMTC_Field_AlbumTrackCount = 5,
+    SMTC_Field_Genres = 6,
+    SMTC_Field_PlaybackType = 7,
+    SMTC_Field_PlaybackStatus = 8,
+    SMTC_Field_PlaybackRate = 9,
+    SMTC_Field_Shuffle = 10,
+    SMTC_Field_RepeatMode = 11,
+    SMTC_Field_EnabledControls = 12,
+    SMTC_Field_Position = 13,
+    SMTC_Field_Duration = 14,
+    SMTC_Field_Cover = 15,
+    SMTC_FieldCount = 16
+};
+
+// enabledControls λ壬Ӧ GlobalSystemMediaTransportControlsSessionPlaybackControls
+enum SMTC_ControlFlags : uint32_t {
+    SMTC_Control_Play = 1u << 0,
+    SMTC_Control_Pause = 1u << 1,
+    SMTC_Control_Stop = 1u << 2,
+    SMTC_Control_Next = 1u << 3,
+    SMTC_Control_Previous = 1u << 4,
+    SMTC_Control_PlayPauseToggle = 1u << 5,
+    SMTC_Control_PlaybackPosition = 1u << 6,
+    SMTC_Control_Shuffle = 1u << 7,
+    SMTC_Control_Repeat = 1u << 8,
+    SMTC_Control_PlaybackRate = 1u << 9
+};
+
+// ַΪ UTF-8  '\0' βʱضϡδ֪ö/ɿֵ -1 ʾplaybackRate Ϊ 0
+struct SMTC_MediaInfo {
+    uint64_t version;          // ζȡʱݰ汾´εʱΪ sinceVersion 
+    uint64_t changedMask;      // 1 << SMTC_Field_*
+    int64_t positionTicks;     // 100ns/tick
+    int64_t durationTicks;
+    uint64_t coverHash;        // ݵ FNV-1a ϣ0 ʾ޷
+    double playbackRate;
+    uint32_t coverSize;        // ֽݱͨ SMTC_GetCoverImage ȡ
+    uint32_t enabledControls;  // SMTC_Control_* λ
+    int32_t trackNumber;
+    int32_t albumTrackCount;
+    int32_t playbackType;      // Windows.Media.MediaPlaybackType0=Unknown, 1=Music, 2=Video, 3=Image
+    int32_t playbackStatus;    // 0=Closed, 1=Opened, 2=Changing, 3=Stopped, 4=Playing, 5=Paused
+    int32_t shuffle;           // 0/1
+    int32_t repeatMode;        // Windows.Media.MediaPlaybackAutoRepeatMode0=None, 1=Track, 2=List
+    char title[512];
+    char artist[512];
+    char albumTitle[512];
+    char albumArtist[512];
+    char genres[256];          //  "; " 
+};
+
+// ================= ʱ =================
+// ʱС + id ȡ/µֻ޸ľĿڵʱ
+// ʱ״̬й queueMutex / queueCvWorker ֻ wait_until ĵʱ䡣
+using TimerClock = std::chrono::steady_clock;
+using TimerId = uint64_t;
+
+//  key ĶʱͬһʱֻһظȻ滻ɵģڷ
+enum class TimerKey : int {
+    MediaProperties = 0, // MediaPropertiesChanged 
+    VolumeFade = 1,      // 䲽
+    TimelinePoll = 2     // ʱѯ
+};
+
+struct TimerEntry {
+    std::function<void()> task;
+    TimerClock::time_point deadline;
+    std::chrono::milliseconds period{ 0 }; // 0 ʾһ
+    int key = -1;
+};
+struct TimerHeapItem {
+    TimerClock::time_point deadline;
+    TimerId id;
+    bool operator>(const TimerHeapItem& other) const { return deadline > other.deadline; }
+};
+
+#if SMTC_FEATURE_SESSION_VOLUME
+// ڼƥ䵽 ISimpleAudioVolumeÿֻһ SetMasterVolumeظöƵỰ
+struct VolumeFadeState {
+    ISimpleAudioVolume* volume = nullptr;
+    float from = 0.0f;
+    float to = 0.0f;
+    TimerClock::time_point start;
+    std::chrono::milliseconds duration{ 0 };
+};
+#endif
+
+// ================= ý˽ӿ =================
+// Worker ֻͨӿڷϵͳýỰĬʵַװ WinRT  SessionManager / Session WinRT ýˣ
+// ѹԹߣSMTC-Bridge-Stressעģʵ֡ȡΪ첽 AsyncRead߳̽
+// ¼̴ͬ߳
+
+// һκ˶ȡĽ˵ Complete ֻеһЧ OnCancel ǼжϷʽ
+// ȴ Completed עɴ Cancel ȡ˱ȡҲһνͨΪĬֵ
+// ִݴ֪εѾء봦ڹ״̬УõȴЭ֡
+template <typename T>
+class AsyncRead {
+public:
+    AsyncRead() : state(std::make_shared<State>()) {}
+
+    void Complete(T value) const {
+        std::function<void()> handler;
+        {
+            std::lock_guard<std::mutex> lk(state->mutex);
+            if (state->done) return;
+            state->result = std::move(value);
+            state->done = true;
+            state->cancel = nullptr;
+            handler = std::move(state->completed);
+        }
+        if (handler) handler();
+    }
+
+    // ȡʱ cancel
+    void OnCancel(std::function<void()> cancel) const {
+        {
+            std::lock_guard<std::mutex> lk(state->mutex);
+            if (state->done) return;
+            if (!state->cancelRequested) { state->cancel = std::move(cancel); return; }
+        }
+        cancel();
+    }
+
+    // handler ǡִһΣʱڵǰִ߳
+    void Completed(std::function<void()> handler) const {
+        {
+            std::lock_guard<std::mutex> lk(state->mutex);
+            if (!state->done) { state->completed = std::move(handler); return; }
+        }
+        handler();
+    }
+
+    void Cancel() const {
+        std::function<void()> cancel;
+        {
+            std::lock_guard<std::mutex> lk(state->mutex);
+            if (state->done || state->cancelRequested) return;
+            state->cancelRequested = true;
+            cancel = std::move(state->cancel);
+        }
+        if (cancel) cancel();
+    }
+
+    bool IsDone() const {
+        std::lock_guard<std::mutex> lk(state->mutex);
+        return state->done;
+    }
+
+    T TakeResult() const {
+        std::lock_guard<std::mutex> lk(state->mutex);
+        return std::move(state->result);
+    }
+
+private:
+    struct State {
+        std::mutex mutex;
+        bool done = false;
+        bool cancelRequested = false;
+        T result{};
+        std::function<void()> completed;
+        std::function<void()> cancel;
+    };
+    std::shared_ptr<State> state;
+};
+
+struct TimelineSnapshot {
+    bool valid = false;
+    int64_t positionTicks = 0;
+    int64_t durationTicks = 0;
+};
+
+struct PlaybackSnapshot {
+    bool valid = false;
+    bool isPlaying = false;
+    int32_t status = -1;
+    int32_t type = -1;
+    double rate = 0.0;
+    int32_t shuffle = -1;
+    int32_t repeatMode = -1;
+    uint32_t controls = 0;
+};
+
+#if SMTC_FEATURE_COVER
+// ȡȡôС÷ݴ˾ǷȡݡʧܻȡʱΪ
+struct IMediaThumbnail {
+    virtual ~IMediaThumbnail() = default;
+    virtual AsyncRead<std::optional<uint64_t>> Open() = 0;
+    virtual AsyncRead<std::optional<std::vector<uint8_t>>> Read() = 0; // ȡ Open ȫֽ
+};
+#endif
+
+struct MediaPropertiesSnapshot {
+    bool valid = false;
+    std::string title;
+    std::string artist;
+    std::string albumTitle;
+    std::string albumArtist;
+    std::string genres;
+    int32_t trackNumber = 0;
+    int32_t albumTrackCount = 0;
+#if SMTC_FEATURE_COVER
+    std::shared_ptr<IMediaThumbnail> thumbnail; // ûзʱΪ
+#endif
+};
+
+#if SMTC_FEATURE_CONTROLS
+enum class MediaCommand { PlayPause, Play, Pause, Next, Previous };
+#endif
+
+struct MediaSessionEvents {
+    std::function<void()> mediaPropertiesChanged;
+    std::function<void()> timelineChanged;
+    std::function<void()> playbackInfoChanged;
+};
+
+struct IMediaSession {
+    virtual ~IMediaSession() = default;
+    virtual std::wstring SourceAppId() = 0;                //  AppUserModelIdƥƵỰ
+    virtual void Subscribe(MediaSessionEvents events) = 0; //  Worker
+    virtual void Unsubscribe() = 0;                        // ʱдִ߳
+    virtual AsyncRead<MediaPropertiesSnapshot> ReadMediaProperties() = 0; // ʧܻȡʱ valid Ϊ false
+    virtual AsyncRead<TimelineSnapshot> ReadTimeline() = 0;
+    virtual AsyncRead<PlaybackSnapshot> ReadPlaybackInfo() = 0;
+#if SMTC_FEATURE_CONTROLS
+    virtual void SendCommand(MediaCommand command) = 0;    // ֻ󣬲ȴӦ Worker
+    virtual void ChangePosition(int64_t positionTicks) = 0;
+#endif
+};
+
+struct IMediaBackend {
+    virtual ~IMediaBackend() = default;
+    // Worker ʱã˿ãshouldStop  true ʱ false
+    virtual bool Start(const std::function<bool()>& shouldStop) = 0;
+    // Worker ˳ǰãע¼ͷϵͳ֮ٴ Start
+    virtual void Stop() = 0;
+    virtual void SubscribeSessionChanged(std::function<void()> handler) = 0;
+    // ѡҪ sessionڲŵģΪϵͳǰ sessionûʱؿ
+    virtual std::shared_ptr<IMediaSession> PickSession() = 0;
+};
+
+#if SMTC_PLATFORM_WINDOWS
+static std::shared_ptr<IMediaBackend> CreateWinRTBackend();
+#endif
+
+// ================= ˲ =================
+// ˵ãȡý/桢ʱᡢϢԼ Core Audio ЭʽУ
+// ȴ˵첽ȡCore Audio ÷ŵִ̳߳Уɺص Worker ̼߳Эڷ
+// Э̾ĳУBackendOp ֻƽǰʱУWorker ȡԼֹͣʱȴ
+enum class OpLane : int {
+    MediaProperties = 0, // ͬһ lane Ĳ˳ִУɽ½ͬ lane Բ
+    Timeline = 1,
+    PlaybackInfo = 2,
+    Volume = 3,
+    Count = 4
+};
+
+// ͬʱ;ĺ˲ĬޣС lane һиͬʱԡʱͲϢ lane
+// ޾ÿͬʱм˵δأȡڵȴصҲ룩
+// ɰĵSMTC_Context::maxBackendOps1 ȫУ
+static const size_t kDefaultMaxBackendOps = 2;
+
+struct BackendOpPromise;
+using BackendOpHandle = std::coroutine_handle<BackendOpPromise>;
+
+struct BackendOpFinal {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(BackendOpHandle h) noexcept;
+    void await_resume() const noexcept {}
+};
+
+struct BackendOp {
+    using promise_type = BackendOpPromise;
+    BackendOpHandle handle;
+
+    explicit BackendOp(BackendOpHandle h) : handle(h) {}
+    BackendOp(BackendOp&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    BackendOp(const BackendOp&) = delete;
+    BackendOp& operator=(const BackendOp&) = delete;
+    ~BackendOp() { if (handle) handle.destroy(); }
+};
+
+struct BackendOpPromise {
+    SMTC_Context* ctx = nullptr;       // Worker ˳ǰЭ̶ѽ٣Ҫӳ
+    OpLane lane = OpLane::MediaProperties;
+    uint64_t generation = 0;           // ʱ session һ¼Ϊȡ
+    uint64_t epoch = 0;                // ʱ Worker ִΣֹͣٵĻָᱻ
+    std::function<void()> cancel;      // ڵȴĺ˶ȡȡ Worker
+
+    BackendOp get_return_object() { return BackendOp{ BackendOpHandle::from_promise(*this) }; }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    BackendOpFinal final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() {} // ȡͺ쳣Э
+};
+
+struct BackendOpCancelled {};
 
+// ================= ͳ =================
+// ʱ/ѹԹ۲βӳٺڴʱ䵥λΪ΢룬λȡڶͰϽ磨 2 
+struct SMTC_LatencyStats {
+    uint64_t count;
+    uint32_t p50Us;
+    uint32_t p99Us;
+    uint32_t p999Us;
+    uint32_t maxUs;
+};
+
+struct SMTC_Stats {
+    uint64_t tasksExecuted;             // Worker ִеڶʱ
+    uint64_t timersFired;               // ɶʱ
+    uint32_t queueLength;               // ǰŶе
+    uint32_t queueHighWater;            // гȵʷֵ
+    SMTC_LatencyStats queueLatency;     // ӣʱڣʼִеĵȴʱ
+    SMTC_LatencyStats taskDuration;     //  Worker ϵִкʱ
+    SMTC_LatencyStats callbackDuration; // ⲿصִкʱص Worker
+    SMTC_LatencyStats eventLatency;     // ¼ﵽ֪ͨⲿص/IPCĶ˵ӳ٣˶ȡ
+    SMTC_LatencyStats getterLatency;    // SMTC_Get* ϵеúʱȴ dataMutex
+    uint64_t coverBytes;                // ǰķֽ
+    uint64_t workingSetBytes;           // ̵ǰ
+    uint64_t peakWorkingSetBytes;       // ̷ֵ
+};
+
+// ֱͼ i Ͱ¼ [2^(i-1), 2^i) ΢룬̲߳ Record
+struct LatencyHistogram {
+    static const int kBuckets = 32;
+    std::atomic<uint64_t> buckets[kBuckets]{};
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> maxUs{ 0 };
+
+    void Record(std::chrono::steady_clock::duration elapsed) {
+        uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        int bucket = 0;
+        for (uint64_t v = us; v > 0 && bucket < kBuckets - 1; v >>= 1) ++bucket;
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        uint64_t prevMax = maxUs.load(std::memory_order_relaxed);
+        while (us > prevMax && !maxUs.compare_exchange_weak(prevMax, us, std::memory_order_relaxed)) {}
+    }
+
+    void Reset() {
+        for (auto& b : buckets) b.store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+        maxUs.store(0, std::memory_order_relaxed);
+    }
+
+    void Snapshot(SMTC_LatencyStats& out) const {
+        uint64_t counts[kBuckets];
+        uint64_t total = 0;
+        for (int i = 0; i < kBuckets; i++) { counts[i] = buckets[i].load(std::memory_order_relaxed); total += counts[i]; }
+        uint64_t maxValue = maxUs.load(std::memory_order_relaxed);
+        auto percentile = [&](double q) -> uint32_t {
+            if (total == 0) return 0;
+            uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+            uint64_t seen = 0;
+            for (int i = 0; i < kBuckets; i++) {
+                seen += counts[i];
+                if (seen >= rank) return static_cast<uint32_t>(std::min<uint64_t>(1ULL << i, maxValue));
+            }
+            return static_cast<uint32_t>(maxValue);
+        };
+        out.count = total;
+        out.p50Us = percentile(0.50);
+        out.p99Us = percentile(0.99);
+        out.p999Us = percentile(0.999);
+        out.maxUs = static_cast<uint32_t>(std::min<uint64_t>(maxValue, UINT32_MAX));
+    }
+};
+
+struct BridgeStats {
+    std::atomic<uint64_t> tasksExecuted{ 0 };
+    std::atomic<uint64_t> timersFired{ 0 };
+    uint32_t queueHighWater = 0; // queueMutex 
+    LatencyHistogram queueLatency;
+    LatencyHistogram taskDuration;
+    LatencyHistogram callbackDuration;
+    LatencyHistogram eventLatency;
+    LatencyHistogram getterLatency;
+};
+
+// ¼ʱ getter ͳ
+struct ScopedLatency {
+    LatencyHistogram& histogram;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    explicit ScopedLatency(LatencyHistogram& h) : histogram(h) {}
+    ~ScopedLatency() { histogram.Record(std::chrono::steady_clock::now() - start); }
+};
+
+struct QueuedTask {
+    std::function<void()> task;
+    TimerClock::time_point enqueueTime;
+};
+
+// ================= Ž =================
+// ÿӵж Worker ̡߳Сʱݺͻص״̬
+// ɵ޾ӿȫתһĬģ DefaultContext
+// ע WorkerĳԱֻڸԼ Worker ߳зʣ
+struct SMTC_Context : std::enable_shared_from_this<SMTC_Context> {
+    // ڣlifecycleMutex л Start/Stop Shutdown  Init ʱͬһ̶߳
+    std::mutex lifecycleMutex;
+    std::atomic<bool> isRunning{ false };
+    std::thread workerThread;
+
+    // ݣdataMutex 
+    std::mutex dataMutex;
+    std::string title;
+    std::string artist;
+    int64_t positionTicks = 0;
+    int64_t durationTicks = 0;
+    bool isPlaying = false;
+    std::atomic<bool> isDataDirty{ false };
+    std::string albumTitle;
+    std::string albumArtist;
+    std::string genres;
+    int32_t trackNumber = 0;
+    int32_t albumTrackCount = 0;
+    int32_t playbackType = -1;
+    int32_t playbackStatus = -1;
+    double playbackRate = 0.0;
+    int32_t shuffle = -1;
+    int32_t repeatMode = -1;
+    uint32_t enabledControls = 0;
+#if SMTC_FEATURE_COVER
+    std::vector<uint8_t> coverBuffer;
+    uint64_t coverHash = 0;
+    bool hasNewCover = false;
+#endif
+    // ÿֶα仯 dataVersion ǵ fieldVersions УdataVersion ڵ
+    uint64_t dataVersion = 0;
+    uint64_t fieldVersions[SMTC_FieldCount]{};
+
+    // ڴԤ㣨߳޸ģWorker ȡǰȡ0 ʾ
+    std::atomic<uint64_t> memoryBudget{ 0 };     // ַ +  + IPC Ͷе
+    std::atomic<uint64_t> ipcQueuedBytes{ 0 };   // пͻ˷Ͷе̸ֽ֮ͣ߳£
+#if SMTC_FEATURE_COVER
+    std::atomic<uint32_t> coverSizeLimit{ 0 };   // ŷĴС
+    std::atomic<bool> suspended{ false };        // ʱҲȡ
+    std::atomic<uint32_t> coversSkipped{ 0 };    // ޻δķ
+#endif
+
+    // ýˣ״ǰãΪʱ Worker ʱ WinRT ʵ֣ǰ session Worker
+    std::shared_ptr<IMediaBackend> backend;
+    std::shared_ptr<IMediaSession> currentSession;
+    bool isChangingSession = false;
+
+    // 붨ʱqueueMutex 
+    std::mutex queueMutex;
+    std::condition_variable queueCv;
+    std::queue<QueuedTask> taskQueue;
+    std::priority_queue<TimerHeapItem, std::vector<TimerHeapItem>, std::greater<TimerHeapItem>> timerHeap;
+    std::unordered_map<TimerId, TimerEntry> timers;
+    std::unordered_map<int, TimerId> keyedTimers;
+    TimerId nextTimerId = 1;
+
+    // ⲿصcallbackMutex Worker ǰһݣ
+    std::mutex callbackMutex;
+    SMTC_UpdateCallback externalCallback = nullptr;
+    SMTC_ContextCallback contextCallback = nullptr;
+    void* contextCallbackUserData = nullptr;
+
+    //  IPC ķserverMutex δʱΪգ
+    std::mutex serverMutex;
+    std::shared_ptr<struct IpcServer> server;
+
+    // ͳ
+    BridgeStats stats;
+
+    // ˲ִ Worker
+    std::vector<BackendOpHandle> runningOps;
+    std::vector<BackendOpHandle> staleOps; // ȡȴ˵÷صĲռ lane
+    std::deque<BackendOpHandle> pendingOps;
+    bool laneBusy[static_cast<int>(OpLane::Count)]{};
+    size_t maxBackendOps = kDefaultMaxBackendOps;
+    bool pumpingOps = false;
+    bool opsStopping = false;
+    uint64_t sessionGeneration = 0; // session лʱʹ session ;ʧЧ
+    uint64_t opsEpoch = 0;          // ÿ Worker ˳ʱ
+
+    // ʱѯ Worker
+#if SMTC_FEATURE_SESSION_VOLUME
+    VolumeFadeState volumeFade;
+#endif
+    std::chrono::milliseconds timelinePollInterval{ 0 };
+};
+
+#if SMTC_FEATURE_MASTER_VOLUME
 // ================= Core Audio helper =================
 // ... ( GetEndpointVolume  ChangeSystemVolumeBy ) ...
 static IAudioEndpointVolume* GetEndpointVolume() { /* ... ԭʵ ... */
@@ -103,7 +658,9 @@ static void SetSystemVolumeTo(float targetVolume) {
 
     pVolume->Release();
 }
+#endif
 
+#if SMTC_FEATURE_SESSION_VOLUME
 // =================  (Audio Session) =================
 
 //  SourceAppUserModelId ȡƥĹؼ֣Сд
@@ -282,22 +839,9 @@ static bool MatchAudioSession(IAudioSessionControl2* pSessionControl2,
     return false;
 }
 
-// ݵǰ SMTC session Ľ̲ҶӦƵỰ
-static bool SetSessionVolumeByProcess(float targetVolume) {
-    if (!g_currentSession) return false;
-    
-    if (targetVolume < 0.0f) targetVolume = 0.0f;
-    if (targetVolume > 1.0f) targetVolume = 1.0f;
-    
-    std::wstring appId;
-    try {
-        hstring hAppId = g_currentSession.SourceAppUserModelId();
-        appId = std::wstring(hAppId.c_str());
-    } catch (...) {
-        return false;
-    }
-    
-    if (appId.empty()) return false;
+// ݵǰ SMTC session  AppUserModelId ҶӦƵỰ ISimpleAudioVolume÷ Release
+static ISimpleAudioVolume* FindSessionVolumeByProcess(const std::wstring& appId) {
+    if (appId.empty()) return nullptr;
     
     std::vector<std::wstring> keywords = ExtractMatchKeywords(appId);
     
@@ -306,7 +850,7 @@ static bool SetSessionVolumeByProcess(float targetVolume) {
     IMMDevice* pDevice = nullptr;
     IAudioSessionManager2* pSessionManager = nullptr;
     IAudioSessionEnumerator* pSessionEnumerator = nullptr;
-    bool success = false;
+    ISimpleAudioVolume* pResult = nullptr;
     
     hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_INPROC_SERVER,
                           __uuidof(IMMDeviceEnumerator), (void**)&pEnumerator);
@@ -327,10 +871,9 @@ static bool SetSessionVolumeByProcess(float targetVolume) {
         hr = pSessionEnumerator->GetCount(&sessionCount);
         if (FAILED(hr)) goto cleanup;
         
-        for (int i = 0; i < sessionCount; i++) {
+        for (int i = 0; i < sessionCount && !pResult; i++) {
             IAudioSessionControl* pSessionControl = nullptr;
             IAudioSessionControl2* pSessionControl2 = nullptr;
-            ISimpleAudioVolume* pSimpleVolume = nullptr;
             
             hr = pSessionEnumerator->GetSession(i, &pSessionControl);
             if (FAILED(hr) || !pSessionControl) {
@@ -352,20 +895,15 @@ static bool SetSessionVolumeByProcess(float targetVolume) {
             }
             
             if (MatchAudioSession(pSessionControl2, keywords)) {
+                ISimpleAudioVolume* pSimpleVolume = nullptr;
                 hr = pSessionControl->QueryInterface(__uuidof(ISimpleAudioVolume), (void**)&pSimpleVolume);
                 if (SUCCEEDED(hr) && pSimpleVolume) {
-                    hr = pSimpleVolume->SetMasterVolume(targetVolume, nullptr);
-                    if (SUCCEEDED(hr)) {
-                        success = true;
-                    }
-                    pSimpleVolume->Release();
+                    pResult = pSimpleVolume;
                 }
             }
             
             pSessionControl2->Release();
             pSessionControl->Release();
-            
-            if (success) break;
         }
     }
     
@@ -375,480 +913,2301 @@ cleanup:
     if (pDevice) pDevice->Release();
     if (pEnumerator) pEnumerator->Release();
     
-    return success;
+    return pResult;
 }
 
-// ݵǰ SMTC session Ľ̵
-static bool ChangeSessionVolumeBy(double delta) {
-    if (!g_currentSession) return false;
-    
-    std::wstring appId;
-    try {
-        hstring hAppId = g_currentSession.SourceAppUserModelId();
-        appId = std::wstring(hAppId.c_str());
-    } catch (...) {
-        return false;
-    }
+// ݵǰ SMTC session Ľ̲ҶӦƵỰ
+static bool SetSessionVolumeByProcess(const std::wstring& appId, float targetVolume) {
+    if (targetVolume < 0.0f) targetVolume = 0.0f;
+    if (targetVolume > 1.0f) targetVolume = 1.0f;
     
-    if (appId.empty()) return false;
+    ISimpleAudioVolume* pSimpleVolume = FindSessionVolumeByProcess(appId);
+    if (!pSimpleVolume) return false;
     
-    std::vector<std::wstring> keywords = ExtractMatchKeywords(appId);
+    bool success = SUCCEEDED(pSimpleVolume->SetMasterVolume(targetVolume, nullptr));
+    pSimpleVolume->Release();
+    return success;
+}
+
+// ݵǰ SMTC session Ľ̵
+static bool ChangeSessionVolumeBy(const std::wstring& appId, double delta) {
+    ISimpleAudioVolume* pSimpleVolume = FindSessionVolumeByProcess(appId);
+    if (!pSimpleVolume) return false;
     
-    HRESULT hr = S_OK;
-    IMMDeviceEnumerator* pEnumerator = nullptr;
-    IMMDevice* pDevice = nullptr;
-    IAudioSessionManager2* pSessionManager = nullptr;
-    IAudioSessionEnumerator* pSessionEnumerator = nullptr;
     bool success = false;
-    
-    hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_INPROC_SERVER,
-                          __uuidof(IMMDeviceEnumerator), (void**)&pEnumerator);
-    if (FAILED(hr) || !pEnumerator) goto cleanup;
-    
-    hr = pEnumerator->GetDefaultAudioEndpoint(eRender, eConsole, &pDevice);
-    if (FAILED(hr) || !pDevice) goto cleanup;
-    
-    hr = pDevice->Activate(__uuidof(IAudioSessionManager2), CLSCTX_INPROC_SERVER,
-                           nullptr, (void**)&pSessionManager);
-    if (FAILED(hr) || !pSessionManager) goto cleanup;
-    
-    hr = pSessionManager->GetSessionEnumerator(&pSessionEnumerator);
-    if (FAILED(hr) || !pSessionEnumerator) goto cleanup;
-    
-    {
-        int sessionCount = 0;
-        hr = pSessionEnumerator->GetCount(&sessionCount);
-        if (FAILED(hr)) goto cleanup;
-        
-        for (int i = 0; i < sessionCount; i++) {
-            IAudioSessionControl* pSessionControl = nullptr;
-            IAudioSessionControl2* pSessionControl2 = nullptr;
-            ISimpleAudioVolume* pSimpleVolume = nullptr;
-            
-            hr = pSessionEnumerator->GetSession(i, &pSessionControl);
-            if (FAILED(hr) || !pSessionControl) {
-                if (pSessionControl) pSessionControl->Release();
-                continue;
-            }
-            
-            hr = pSessionControl->QueryInterface(__uuidof(IAudioSessionControl2), (void**)&pSessionControl2);
-            if (FAILED(hr) || !pSessionControl2) {
-                pSessionControl->Release();
-                continue;
-            }
-            
-            if (pSessionControl2->IsSystemSoundsSession() == S_OK) {
-                pSessionControl2->Release();
-                pSessionControl->Release();
-                continue;
-            }
-            
-            if (MatchAudioSession(pSessionControl2, keywords)) {
-                hr = pSessionControl->QueryInterface(__uuidof(ISimpleAudioVolume), (void**)&pSimpleVolume);
-                if (SUCCEEDED(hr) && pSimpleVolume) {
-                    float currentVolume = 0.0f;
-                    hr = pSimpleVolume->GetMasterVolume(&currentVolume);
-                    if (SUCCEEDED(hr)) {
-                        float newVolume = currentVolume + static_cast<float>(delta);
-                        if (newVolume < 0.0f) newVolume = 0.0f;
-                        if (newVolume > 1.0f) newVolume = 1.0f;
-                        hr = pSimpleVolume->SetMasterVolume(newVolume, nullptr);
-                        if (SUCCEEDED(hr)) {
-                            success = true;
-                        }
-                    }
-                    pSimpleVolume->Release();
-                }
-            }
-            
-            pSessionControl2->Release();
-            pSessionControl->Release();
-            
-            if (success) break;
-        }
+    float currentVolume = 0.0f;
+    if (SUCCEEDED(pSimpleVolume->GetMasterVolume(&currentVolume))) {
+        float newVolume = currentVolume + static_cast<float>(delta);
+        if (newVolume < 0.0f) newVolume = 0.0f;
+        if (newVolume > 1.0f) newVolume = 1.0f;
+        success = SUCCEEDED(pSimpleVolume->SetMasterVolume(newVolume, nullptr));
     }
-    
-cleanup:
-    if (pSessionEnumerator) pSessionEnumerator->Release();
-    if (pSessionManager) pSessionManager->Release();
-    if (pDevice) pDevice->Release();
-    if (pEnumerator) pEnumerator->Release();
-    
+    pSimpleVolume->Release();
     return success;
 }
+#endif
 
 // =================  =================
+#if SMTC_PLATFORM_WINDOWS
 static std::string WinRTStringToString(hstring const& hstr) {
     return winrt::to_string(hstr);
 }
-static void EnqueueTask(std::function<void()> task) { /* ... ԭʵ ... */
-    { std::lock_guard<std::mutex> lk(g_queueMutex); g_taskQueue.push(std::move(task)); } g_queueCv.notify_one();
+#endif
+
+// µֶΣֵб仯ʱ¼ֶΰ汾÷ dataMutex
+template <typename T>
+static bool UpdateField_Locked(SMTC_Context* ctx, SMTC_Field field, T& slot, const T& value) {
+    if (slot == value) return false;
+    slot = value;
+    ctx->fieldVersions[field] = ++ctx->dataVersion;
+    return true;
 }
-static void UnregisterCurrentSessionEvents() { /* ... ԭʵ ... */
-    try {
-        if (g_currentSession) {
-            if (g_mediaPropertiesToken.value) { try { g_currentSession.MediaPropertiesChanged(g_mediaPropertiesToken); } catch (...) {} g_mediaPropertiesToken = {}; }
-            if (g_timelinePropertiesToken.value) { try { g_currentSession.TimelinePropertiesChanged(g_timelinePropertiesToken); } catch (...) {} g_timelinePropertiesToken = {}; }
-            if (g_playbackInfoToken.value) { try { g_currentSession.PlaybackInfoChanged(g_playbackInfoToken); } catch (...) {} g_playbackInfoToken = {}; }
-        }
-    }
-    catch (...) {}
+
+static void MarkAllFieldsChanged_Locked(SMTC_Context* ctx) {
+    ++ctx->dataVersion;
+    for (auto& v : ctx->fieldVersions) v = ctx->dataVersion;
 }
 
-// ** C# صȫ Worker ߳У**
-static void TriggerCallback(SMTC_EventType eventType) {
-    if (g_externalCallback) {
-        // Ҫ C++ worker ̵߳ C# 
-        // C# ҪǷҪ Marshal ̡߳
-        g_externalCallback(eventType);
+// ǰʵṩֶΣüֶԶڱ仯У
+static constexpr uint64_t kAvailableFieldMask = ((1ULL << SMTC_FieldCount) - 1) & ~(SMTC_FEATURE_COVER ? 0ULL : (1ULL << SMTC_Field_Cover));
+
+// sinceVersion Ϊ 0 ʾ÷δȡȫֶΣΪĬֵ -1δ仯ֶ
+static uint64_t ChangedFieldMask_Locked(SMTC_Context* ctx, uint64_t sinceVersion) {
+    if (sinceVersion == 0) return kAvailableFieldMask;
+    uint64_t mask = 0;
+    for (int i = 0; i < SMTC_FieldCount; i++) {
+        if (ctx->fieldVersions[i] > sinceVersion) mask |= 1ULL << i;
     }
+    return mask & kAvailableFieldMask;
 }
 
+#if SMTC_FEATURE_COVER
+// ͷŷ滺棨swap 黹clear ͷڴ棩ǷĶ
+static bool DropCover_Locked(SMTC_Context* ctx) {
+    if (ctx->coverBuffer.empty() && ctx->coverHash == 0) return false;
+    std::vector<uint8_t>().swap(ctx->coverBuffer);
+    ctx->coverHash = 0;
+    ctx->hasNewCover = false;
+    ctx->fieldVersions[SMTC_Field_Cover] = ++ctx->dataVersion;
+    return true;
+}
+#endif
 
-// ================= Update  Worker ִ߳У =================
-fire_and_forget UpdateMediaProperties(GlobalSystemMediaTransportControlsSession session) {
-    try {
-        auto strongSession = session;
-        auto props = co_await strongSession.TryGetMediaPropertiesAsync();
+// ǰַռֽƣ
+static size_t StringBytes_Locked(SMTC_Context* ctx) {
+    return ctx->title.capacity() + ctx->artist.capacity() + ctx->albumTitle.capacity() + ctx->albumArtist.capacity() + ctx->genres.capacity();
+}
 
-        if (!props) co_return;
+#if SMTC_FEATURE_COVER
+// Ƿһ coverSize ֽڵķ棨÷ dataMutex
+static bool CoverAllowed_Locked(SMTC_Context* ctx, uint64_t coverSize) {
+    if (ctx->suspended.load()) return false;
+    uint32_t limit = ctx->coverSizeLimit.load();
+    if (limit && coverSize > limit) return false;
+    uint64_t budget = ctx->memoryBudget.load();
+    if (budget && StringBytes_Locked(ctx) + ctx->ipcQueuedBytes.load() + coverSize > budget) return false;
+    return true;
+}
 
-        bool changed = false;
-        {
-            std::lock_guard<std::mutex> lk(g_dataMutex);
-            std::string newTitle = WinRTStringToString(props.Title());
-            std::string newArtist = WinRTStringToString(props.Artist());
-
-            if (g_title != newTitle || g_artist != newArtist) {
-                g_title = std::move(newTitle);
-                g_artist = std::move(newArtist);
-                changed = true;
-            }
-        }
+static uint64_t HashBytes(const std::vector<uint8_t>& data) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    for (uint8_t b : data) { hash ^= b; hash *= 1099511628211ULL; }
+    return hash;
+}
+#endif
+static void EnqueueTask(SMTC_Context* ctx, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lk(ctx->queueMutex);
+        ctx->taskQueue.push({ std::move(task), TimerClock::now() });
+        ctx->stats.queueHighWater = std::max<uint32_t>(ctx->stats.queueHighWater, static_cast<uint32_t>(ctx->taskQueue.size()));
+    }
+    ctx->queueCv.notify_one();
+}
 
-        // 
-        auto thumbRef = props.Thumbnail();
-        if (thumbRef) {
-            auto stream = co_await thumbRef.OpenReadAsync();
-            if (stream) {
-                // ... (ȡд g_coverBuffer ߼) ...
-                DataReader reader(stream);
-                uint32_t size = static_cast<uint32_t>(stream.Size());
-                co_await reader.LoadAsync(size);
-
-                std::vector<uint8_t> localBuf(size);
-                reader.ReadBytes(localBuf);
-
-                {
-                    std::lock_guard<std::mutex> lk(g_dataMutex);
-                    // ʵĿУҪȽ localBuf  g_coverBuffer ⲻҪĸ
-                    // Ǽ򵥵Ϊȡɹ͸
-                    g_coverBuffer = std::move(localBuf);
-                    g_hasNewCover = true;
-                    changed = true; // 仯Ҳ MediaPropertiesChanged
-                }
-            }
-        }
-        else {
-            std::lock_guard<std::mutex> lk(g_dataMutex);
-            if (!g_coverBuffer.empty()) {
-                g_coverBuffer.clear();
-                g_hasNewCover = false;
-                changed = true;
-            }
-        }
+// ================= ʱں Worker ִ߳У =================
+static TimerId ScheduleTimer_Locked(SMTC_Context* ctx, std::chrono::milliseconds delay, std::function<void()> task, std::chrono::milliseconds period, int key) {
+    TimerId id = ctx->nextTimerId++;
+    TimerEntry entry;
+    entry.task = std::move(task);
+    entry.deadline = TimerClock::now() + delay;
+    entry.period = period;
+    entry.key = key;
+    ctx->timerHeap.push({ entry.deadline, id });
+    ctx->timers.emplace(id, std::move(entry));
+    return id;
+}
 
-        if (changed) {
-            g_isDataDirty.store(true);
-            TriggerCallback(SMTC_EventType::MediaPropertiesChanged);
-        }
+static void CancelKeyedTimer_Locked(SMTC_Context* ctx, TimerKey key) {
+    auto it = ctx->keyedTimers.find(static_cast<int>(key));
+    if (it != ctx->keyedTimers.end()) {
+        ctx->timers.erase(it->second);
+        ctx->keyedTimers.erase(it);
     }
-    catch (...) { /* 쳣 */ }
 }
 
-static void UpdateTimeline_Internal(GlobalSystemMediaTransportControlsSession session) {
-    try {
-        auto timeline = session.GetTimelineProperties();
-        if (timeline) {
-            bool changed = false;
-            {
-                std::lock_guard<std::mutex> lk(g_dataMutex);
-                int64_t newPosition = timeline.Position().count();
-                int64_t newDuration = timeline.EndTime().count();
-
-                if (g_positionTicks != newPosition || g_durationTicks != newDuration) {
-                    g_positionTicks = newPosition;
-                    g_durationTicks = newDuration;
-                    changed = true;
-                }
-            }
-            if (changed) {
-                g_isDataDirty.store(true);
-                TriggerCallback(SMTC_EventType::TimelineChanged);
-            }
-        }
+// 滻ͬ key ĶʱһԶʱΪִֻһεȣ
+static void ScheduleKeyedTimer(SMTC_Context* ctx, TimerKey key, std::chrono::milliseconds delay, std::function<void()> task, std::chrono::milliseconds period = std::chrono::milliseconds(0)) {
+    {
+        std::lock_guard<std::mutex> lk(ctx->queueMutex);
+        CancelKeyedTimer_Locked(ctx, key);
+        ctx->keyedTimers[static_cast<int>(key)] = ScheduleTimer_Locked(ctx, delay, std::move(task), period, static_cast<int>(key));
     }
-    catch (...) {}
+    ctx->queueCv.notify_one();
 }
 
-static void UpdatePlaybackInfo_Internal(GlobalSystemMediaTransportControlsSession session) {
-    try {
-        auto info = session.GetPlaybackInfo();
-        if (info) {
-            bool changed = false;
-            {
-                std::lock_guard<std::mutex> lk(g_dataMutex);
-                bool newIsPlaying = (info.PlaybackStatus() == GlobalSystemMediaTransportControlsSessionPlaybackStatus::Playing);
-                if (g_isPlaying != newIsPlaying) {
-                    g_isPlaying = newIsPlaying;
-                    changed = true;
-                }
-            }
-            if (changed) {
-                g_isDataDirty.store(true);
-                TriggerCallback(SMTC_EventType::PlaybackStatusChanged);
-            }
+static void CancelKeyedTimer(SMTC_Context* ctx, TimerKey key) {
+    std::lock_guard<std::mutex> lk(ctx->queueMutex);
+    CancelKeyedTimer_Locked(ctx, key);
+}
+
+// ȡһѵڵĶʱ䵽ʱ䣻ûеʱͨ nextDeadline ĵʱ䣨޶ʱʱΪ max
+static bool PopDueTimer_Locked(SMTC_Context* ctx, std::function<void()>& task, TimerClock::time_point& dueTime, TimerClock::time_point& nextDeadline) {
+    auto now = TimerClock::now();
+    while (!ctx->timerHeap.empty()) {
+        TimerHeapItem top = ctx->timerHeap.top();
+        auto it = ctx->timers.find(top.id);
+        if (it == ctx->timers.end() || it->second.deadline != top.deadline) { ctx->timerHeap.pop(); continue; } // ȡµ
+        if (top.deadline > now) { nextDeadline = top.deadline; return false; }
+
+        ctx->timerHeap.pop();
+        dueTime = top.deadline;
+        TimerEntry& entry = it->second;
+        if (entry.period.count() > 0) {
+            task = entry.task;
+            // 񰴹̶ƽ Worker ̫ӵǰʱ㣬ⲹһѹִ
+            entry.deadline += entry.period;
+            if (entry.deadline <= now) entry.deadline = now + entry.period;
+            ctx->timerHeap.push({ entry.deadline, top.id });
+        }
+        else {
+            task = std::move(entry.task);
+            if (entry.key >= 0) ctx->keyedTimers.erase(entry.key);
+            ctx->timers.erase(it);
         }
+        return true;
     }
-    catch (...) {}
+    nextDeadline = TimerClock::time_point::max();
+    return false;
 }
 
-// ... (SetupSessionEvents_Internal, OnSessionManagerChanged_Internal, WorkerThreadFunc ԭ߼ OnSessionManagerChanged_Internal Ӧ󴥷 SessionChanged ¼) ...
-static void SetupSessionEvents_Internal(GlobalSystemMediaTransportControlsSession session) {
-    if (!session) return;
-    winrt::weak_ref<GlobalSystemMediaTransportControlsSession> weakSession{ session };
+static void ClearTimers(SMTC_Context* ctx) {
+    std::lock_guard<std::mutex> lk(ctx->queueMutex);
+    ctx->timerHeap = {};
+    ctx->timers.clear();
+    ctx->keyedTimers.clear();
+}
+static void UnregisterCurrentSessionEvents(SMTC_Context* ctx) {
+    if (ctx->currentSession) ctx->currentSession->Unsubscribe();
+}
 
-    g_mediaPropertiesToken = session.MediaPropertiesChanged([weakSession](auto&& s, auto&&) {
-        EnqueueTask([weakSession]() { if (auto strong = weakSession.get()) { UpdateMediaProperties(strong); } });
-        });
-    g_timelinePropertiesToken = session.TimelinePropertiesChanged([weakSession](auto&& s, auto&&) {
-        EnqueueTask([weakSession]() { if (auto strong = weakSession.get()) { UpdateTimeline_Internal(strong); } });
-        });
-    g_playbackInfoToken = session.PlaybackInfoChanged([weakSession](auto&& s, auto&&) {
-        EnqueueTask([weakSession]() { if (auto strong = weakSession.get()) { UpdatePlaybackInfo_Internal(strong); } });
-        });
+static void PublishIpcDelta(SMTC_Context* ctx);
+static void StopIpcServer(SMTC_Context* ctx);
 
-    // һγʼȡ
-    EnqueueTask([weakSession]() {
-        if (auto strong = weakSession.get()) {
-            UpdateMediaProperties(strong);
-            UpdateTimeline_Internal(strong);
-            UpdatePlaybackInfo_Internal(strong);
-        }
-        });
+// ** C# صȫ Worker ߳У**
+// origin Ϊ֪ͨĺ¼ʱ䣬ͳ¼Ͷӳ٣ɺ¼ʱĬֵ
+static void TriggerCallback(SMTC_Context* ctx, SMTC_EventType eventType, TimerClock::time_point origin = {}) {
+    SMTC_UpdateCallback externalCallback;
+    SMTC_ContextCallback contextCallback;
+    void* userData;
+    {
+        std::lock_guard<std::mutex> lk(ctx->callbackMutex);
+        externalCallback = ctx->externalCallback;
+        contextCallback = ctx->contextCallback;
+        userData = ctx->contextCallbackUserData;
+    }
+    PublishIpcDelta(ctx);
+    if (origin != TimerClock::time_point{}) ctx->stats.eventLatency.Record(TimerClock::now() - origin);
+    if (!externalCallback && !contextCallback) return;
+
+    // Ҫ C++ worker ̵߳ C# 
+    // C# ҪǷҪ Marshal ̡߳
+    auto start = std::chrono::steady_clock::now();
+    if (externalCallback) {
+        externalCallback(eventType);
+    }
+    if (contextCallback) {
+        contextCallback(ctx, eventType, userData);
+    }
+    ctx->stats.callbackDuration.Record(std::chrono::steady_clock::now() - start);
 }
 
+// ================= ˲ִ Worker =================
+static const std::chrono::milliseconds kBackendDrainTimeout{ 2000 };  // ֹͣʱȴ;
 
-static void OnSessionManagerChanged_Internal() {
-    if (!g_manager) return;
-    if (g_isChangingSession) return;
-    g_isChangingSession = true;
+static void PumpBackendOps(SMTC_Context* ctx);
 
-    UnregisterCurrentSessionEvents();
-    g_currentSession = nullptr;
+static bool IsLaneBusy(SMTC_Context* ctx, OpLane lane) { return ctx->laneBusy[static_cast<int>(lane)]; }
 
-    GlobalSystemMediaTransportControlsSession bestSession = nullptr;
-    try {
-        auto sessions = g_manager.GetSessions();
-        for (auto const& s : sessions) {
-            try {
-                auto info = s.GetPlaybackInfo();
-                if (info && info.PlaybackStatus() == GlobalSystemMediaTransportControlsSessionPlaybackStatus::Playing) {
-                    bestSession = s;
-                    break;
-                }
-            }
-            catch (...) {}
-        }
-        if (!bestSession) {
-            bestSession = g_manager.GetCurrentSession();
-        }
-    }
-    catch (...) {}
+// Э̵ĻָͶݻ Worker̵߳áWorker ѽһ֣epoch 仯ʱ
+static void ResumeOnWorker(SMTC_Context* ctx, BackendOpHandle h, uint64_t epoch) {
+    EnqueueTask(ctx, [ctx, h, epoch]() { if (ctx->opsEpoch == epoch) h.resume(); });
+}
 
-    g_currentSession = bestSession;
-    if (g_currentSession) {
-        SetupSessionEvents_Internal(g_currentSession);
-        // ȷ״μҲ¼Ϊ SetupSessionEvents_Internal  Enqueue ʼȡ
-    }
+static void ThrowIfCancelled(BackendOpPromise& promise) {
+    SMTC_Context* ctx = promise.ctx;
+    if (ctx->opsStopping || promise.generation != ctx->sessionGeneration) throw BackendOpCancelled{};
+}
 
-    g_isChangingSession = false;
+// co_await OnWorker(read)ȴ˶ȡɺ Worker ϻָȡȡʱж϶ȡ
+template <typename T>
+struct ReadOnWorker {
+    AsyncRead<T> read;
+    BackendOpPromise* promise = nullptr;
+
+    bool await_ready() const { return read.IsDone(); }
+    void await_suspend(BackendOpHandle h) {
+        promise = &h.promise();
+        promise->cancel = [read = read]() { read.Cancel(); };
+        // ɴֻĵ weak_ptrִΣЭ֡ DrainBackendOps 󣬳ٵĻִָβ
+        read.Completed([weakCtx = promise->ctx->weak_from_this(), h, epoch = promise->epoch]() {
+            // Ӻ Worker ָ̻Э̣һֱ֪ͨ
+            if (auto ctx = weakCtx.lock()) ResumeOnWorker(ctx.get(), h, epoch);
+            });
+    }
+    T await_resume() {
+        if (promise) {
+            promise->cancel = nullptr;
+            ThrowIfCancelled(*promise);
+        }
+        return read.TakeResult();
+    }
+};
+template <typename T>
+static ReadOnWorker<T> OnWorker(AsyncRead<T> read) { return ReadOnWorker<T>{ std::move(read) }; }
 
-    // **Session лɣ֪ͨⲿ**
-    g_isDataDirty.store(true);
-    TriggerCallback(SMTC_EventType::SessionChanged);
+#if SMTC_PLATFORM_WINDOWS
+static void __stdcall RunThreadPoolWork(PTP_CALLBACK_INSTANCE, void* param) {
+    std::unique_ptr<std::function<void()>> work(static_cast<std::function<void()>*>(param));
+    (*work)();
 }
 
+// ִ̳߳ work̳߳زʱ˻Ϊڵǰִ߳ͬ
+static void RunInThreadPool(std::function<void()> work) {
+    auto* heap = new std::function<void()>(std::move(work));
+    if (!TrySubmitThreadpoolCallback(&RunThreadPoolWork, heap, nullptr)) RunThreadPoolWork(nullptr, heap);
+}
 
-static void WorkerThreadFunc() {
-    init_apartment();
+// co_await InBackground(fn)ִ̳߳ãɺ Worker ϻָ fn Ľ
+// ޷жϣȡҪأᱻ
+template <typename F>
+static ReadOnWorker<std::invoke_result_t<F&>> InBackground(F fn) {
+    using Result = std::invoke_result_t<F&>;
+    AsyncRead<Result> read;
+    RunInThreadPool([read, fn = std::move(fn)]() mutable {
+        try { read.Complete(fn()); }
+        catch (...) { read.Complete(Result{}); }
+        });
+    return OnWorker(std::move(read));
+}
+#endif
+
+// ӹЭ̲ lane Ŷӣcoalesce Ϊ true ʱͬһ lane δʼĲΣͬ
+static void SpawnBackendOp(SMTC_Context* ctx, OpLane lane, BackendOp op, bool coalesce = false) {
+    if (ctx->opsStopping) return; // op ʱЭ
+    if (coalesce) {
+        for (auto pending : ctx->pendingOps) {
+            if (pending.promise().lane == lane) return;
+        }
+    }
+    BackendOpHandle h = std::exchange(op.handle, nullptr);
+    BackendOpPromise& promise = h.promise();
+    promise.ctx = ctx;
+    promise.lane = lane;
+    promise.generation = ctx->sessionGeneration;
+    promise.epoch = ctx->opsEpoch;
+    ctx->pendingOps.push_back(h);
+    PumpBackendOps(ctx);
+}
+
+//  lane ԼŶӵĲЭ̿ͬ겢뱾ʱѭ
+// ȡĲͬռƵл session ʱ²ҪȾɵĺ˵÷زδصĵ
+static void PumpBackendOps(SMTC_Context* ctx) {
+    if (ctx->pumpingOps) return;
+    ctx->pumpingOps = true;
+    bool started = true;
+    while (started && ctx->runningOps.size() + ctx->staleOps.size() < ctx->maxBackendOps) {
+        started = false;
+        for (auto it = ctx->pendingOps.begin(); it != ctx->pendingOps.end(); ++it) {
+            OpLane lane = it->promise().lane;
+            if (IsLaneBusy(ctx, lane)) continue;
+            BackendOpHandle h = *it;
+            ctx->pendingOps.erase(it);
+            ctx->laneBusy[static_cast<int>(lane)] = true;
+            ctx->runningOps.push_back(h);
+            h.resume();
+            started = true;
+            break;
+        }
+    }
+    ctx->pumpingOps = false;
+}
+
+// Э̽쳣ȡʱ Worker ϵ
+void BackendOpFinal::await_suspend(BackendOpHandle h) noexcept {
+    SMTC_Context* ctx = h.promise().ctx;
+    auto& running = ctx->runningOps;
+    auto it = std::find(running.begin(), running.end(), h);
+    if (it != running.end()) {
+        running.erase(it);
+        ctx->laneBusy[static_cast<int>(h.promise().lane)] = false;
+    }
+    else {
+        auto& stale = ctx->staleOps;
+        stale.erase(std::remove(stale.begin(), stale.end(), h), stale.end());
+    }
+    h.destroy();
+    if (!ctx->opsStopping) PumpBackendOps(ctx);
+}
+
+// session лֹͣʱãδʼĲж;Ķȡ;ת staleOps ͷ lane
+// ɲص Worker ʱһֱӽڳ session Ĳ
+static void CancelBackendOps(SMTC_Context* ctx) {
+    ++ctx->sessionGeneration;
+    std::deque<BackendOpHandle> pending;
+    pending.swap(ctx->pendingOps);
+    for (auto h : pending) h.destroy();
+    for (auto h : ctx->runningOps) {
+        if (auto cancel = std::exchange(h.promise().cancel, nullptr)) cancel();
+    }
+    ctx->staleOps.insert(ctx->staleOps.end(), ctx->runningOps.begin(), ctx->runningOps.end());
+    ctx->runningOps.clear();
+    std::fill(std::begin(ctx->laneBusy), std::end(ctx->laneBusy), false);
+}
+
+// Worker ˳ǰãȡȫִУֱ;Э̶ص Worker 
+// ʱδصĺ˵ñֱЭ֡ȡɴ AsyncRead Ĺ״̬У
+// ٵֻͶһָepoch ûָ
+static void DrainBackendOps(SMTC_Context* ctx) {
+    ctx->opsStopping = true;
+    CancelBackendOps(ctx);
+    auto deadline = TimerClock::now() + kBackendDrainTimeout;
+    while (!ctx->staleOps.empty()) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lk(ctx->queueMutex);
+            if (!ctx->queueCv.wait_until(lk, deadline, [ctx]() { return !ctx->taskQueue.empty(); })) break;
+            task = std::move(ctx->taskQueue.front().task);
+            ctx->taskQueue.pop();
+        }
+        try { task(); }
+        catch (...) {}
+    }
+    for (auto h : ctx->staleOps) h.destroy();
+    ctx->staleOps.clear();
+    ++ctx->opsEpoch;
+    ctx->opsStopping = false;
+}
 
-    //  manager
+#if SMTC_FEATURE_SESSION_VOLUME
+// ================= 䣨 Worker ʱ =================
+static const std::chrono::milliseconds kVolumeFadeStep{ 20 }; // 50 Hz 
+
+static void StopVolumeFade(SMTC_Context* ctx) {
+    CancelKeyedTimer(ctx, TimerKey::VolumeFade);
+    if (ctx->volumeFade.volume) {
+        ctx->volumeFade.volume->Release();
+        ctx->volumeFade.volume = nullptr;
+    }
+}
+
+static void VolumeFadeTick(SMTC_Context* ctx) {
+    VolumeFadeState& fade = ctx->volumeFade;
+    if (!fade.volume) { CancelKeyedTimer(ctx, TimerKey::VolumeFade); return; }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(TimerClock::now() - fade.start);
+    float t = static_cast<float>(elapsed.count()) / static_cast<float>(fade.duration.count());
+    if (t > 1.0f) t = 1.0f;
+
+    float value = fade.from + (fade.to - fade.from) * t;
+    HRESULT hr = fade.volume->SetMasterVolume(value, nullptr);
+    if (FAILED(hr) || t >= 1.0f) {
+        StopVolumeFade(ctx);
+    }
+}
+
+struct ComRelease { template <typename T> void operator()(T* p) const { if (p) p->Release(); } };
+using SimpleVolumePtr = std::unique_ptr<ISimpleAudioVolume, ComRelease>;
+
+static std::wstring SessionAppId(const std::shared_ptr<IMediaSession>& session) {
+    return session ? session->SourceAppId() : std::wstring();
+}
+
+//  durationMs ڰѵǰԹɵ targetVolumeµڽеĽ䡣
+// öƵỰ̳߳ɣõӿںص Worker ʼ
+static BackendOp StartVolumeFade(SMTC_Context* ctx, std::shared_ptr<IMediaSession> session, float targetVolume, int durationMs) {
+    StopVolumeFade(ctx);
+
+    if (targetVolume < 0.0f) targetVolume = 0.0f;
+    if (targetVolume > 1.0f) targetVolume = 1.0f;
+
+    if (durationMs <= 0) {
+        co_await InBackground([session, targetVolume]() { return SetSessionVolumeByProcess(SessionAppId(session), targetVolume); });
+        co_return;
+    }
+
+    struct FadeSource { SimpleVolumePtr volume; float current = 0.0f; };
+    FadeSource source = co_await InBackground([session]() {
+        FadeSource found;
+        found.volume.reset(FindSessionVolumeByProcess(SessionAppId(session)));
+        if (found.volume && FAILED(found.volume->GetMasterVolume(&found.current))) found.volume.reset();
+        return found;
+        });
+    if (!source.volume) co_return;
+
+    ctx->volumeFade.volume = source.volume.release();
+    ctx->volumeFade.from = source.current;
+    ctx->volumeFade.to = targetVolume;
+    ctx->volumeFade.start = TimerClock::now();
+    ctx->volumeFade.duration = std::chrono::milliseconds(durationMs);
+    ScheduleKeyedTimer(ctx, TimerKey::VolumeFade, kVolumeFadeStep, [ctx]() { VolumeFadeTick(ctx); }, kVolumeFadeStep);
+}
+
+// relative Ϊ true ʱ value ֱãͬڽеĽ
+static BackendOp ChangeVolume(SMTC_Context* ctx, std::shared_ptr<IMediaSession> session, float value, bool relative) {
+    StopVolumeFade(ctx);
+    co_await InBackground([session, value, relative]() {
+        std::wstring appId = SessionAppId(session);
+        return relative ? ChangeSessionVolumeBy(appId, value) : SetSessionVolumeByProcess(appId, value);
+        });
+}
+#endif
+
+#if SMTC_FEATURE_MASTER_VOLUME
+// ϵͳrelative Ϊ true ʱ value ֱ
+static BackendOp ChangeSystemVolume(float value, bool relative) {
+    co_await InBackground([value, relative]() {
+        if (relative) ChangeSystemVolumeBy(value);
+        else SetSystemVolumeTo(value);
+        return true;
+        });
+}
+#endif
+
+
+#if SMTC_PLATFORM_WINDOWS
+// ================= WinRT ý =================
+// IMediaBackend Ĭʵ֡첽ȡ WinRT ɻصнȡʱ IAsyncInfo::Cancel
+// ٳٲӦҲռס̡߳GetTimelineProperties / GetPlaybackInfo ͬãŵִ̳߳У޷жϡ
+#if SMTC_FEATURE_COVER
+struct WinRTThumbnail : IMediaThumbnail {
+    IRandomAccessStreamReference ref;
+    // Open õ Readɻصڱ٣˷ڹ״̬
+    std::shared_ptr<IRandomAccessStreamWithContentType> stream = std::make_shared<IRandomAccessStreamWithContentType>(nullptr);
+
+    explicit WinRTThumbnail(IRandomAccessStreamReference thumbRef) : ref(std::move(thumbRef)) {}
+
+    AsyncRead<std::optional<uint64_t>> Open() override {
+        AsyncRead<std::optional<uint64_t>> read;
+        try {
+            auto async = ref.OpenReadAsync();
+            read.OnCancel([async]() { try { async.Cancel(); } catch (...) {} });
+            async.Completed([read, stream = stream](auto const& op, AsyncStatus status) {
+                std::optional<uint64_t> size;
+                try {
+                    if (status == AsyncStatus::Completed) {
+                        *stream = op.GetResults();
+                        if (*stream) size = stream->Size();
+                    }
+                }
+                catch (...) { size.reset(); }
+                read.Complete(size);
+                });
+        }
+        catch (...) { read.Complete(std::nullopt); }
+        return read;
+    }
+
+    AsyncRead<std::optional<std::vector<uint8_t>>> Read() override {
+        AsyncRead<std::optional<std::vector<uint8_t>>> read;
+        try {
+            IRandomAccessStreamWithContentType opened = std::exchange(*stream, nullptr);
+            if (!opened) { read.Complete(std::nullopt); return read; }
+            DataReader reader(opened);
+            auto load = reader.LoadAsync(static_cast<uint32_t>(std::min<uint64_t>(opened.Size(), UINT32_MAX)));
+            read.OnCancel([load]() { try { load.Cancel(); } catch (...) {} });
+            load.Completed([read, reader, opened](auto const& op, AsyncStatus status) {
+                std::optional<std::vector<uint8_t>> bytes;
+                try {
+                    if (status == AsyncStatus::Completed) {
+                        std::vector<uint8_t> out(op.GetResults());
+                        reader.ReadBytes(out);
+                        bytes = std::move(out);
+                    }
+                    reader.Close(); // ͷ DataReader ڲ
+                }
+                catch (...) { bytes.reset(); }
+                read.Complete(std::move(bytes));
+                });
+        }
+        catch (...) { read.Complete(std::nullopt); }
+        return read;
+    }
+};
+#endif
+
+static MediaPropertiesSnapshot ToSnapshot(GlobalSystemMediaTransportControlsSessionMediaProperties const& props) {
+    MediaPropertiesSnapshot read;
     try {
-        auto op = GlobalSystemMediaTransportControlsSessionManager::RequestAsync();
-        while (op.Status() == AsyncStatus::Started && g_isRunning.load()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (!props) return read;
+        read.valid = true;
+        read.title = WinRTStringToString(props.Title());
+        read.artist = WinRTStringToString(props.Artist());
+        read.albumTitle = WinRTStringToString(props.AlbumTitle());
+        read.albumArtist = WinRTStringToString(props.AlbumArtist());
+        for (auto const& genre : props.Genres()) {
+            if (!read.genres.empty()) read.genres += "; ";
+            read.genres += WinRTStringToString(genre);
+        }
+        read.trackNumber = props.TrackNumber();
+        read.albumTrackCount = props.AlbumTrackCount();
+#if SMTC_FEATURE_COVER
+        if (auto thumbRef = props.Thumbnail()) read.thumbnail = std::make_shared<WinRTThumbnail>(thumbRef);
+#endif
+    }
+    catch (...) { read.valid = false; }
+    return read;
+}
+
+static TimelineSnapshot ReadTimelineSnapshot(GlobalSystemMediaTransportControlsSession const& session) {
+    TimelineSnapshot read;
+    try {
+        auto timeline = session.GetTimelineProperties();
+        if (timeline) {
+            read.valid = true;
+            read.positionTicks = timeline.Position().count();
+            read.durationTicks = timeline.EndTime().count();
+        }
+    }
+    catch (...) {}
+    return read;
+}
+
+static PlaybackSnapshot ReadPlaybackSnapshot(GlobalSystemMediaTransportControlsSession const& session) {
+    PlaybackSnapshot read;
+    try {
+        auto info = session.GetPlaybackInfo();
+        if (info) {
+            auto status = info.PlaybackStatus();
+            read.valid = true;
+            read.isPlaying = (status == GlobalSystemMediaTransportControlsSessionPlaybackStatus::Playing);
+            read.status = static_cast<int32_t>(status);
+            auto type = info.PlaybackType();
+            read.type = type ? static_cast<int32_t>(type.Value()) : -1;
+            auto rate = info.PlaybackRate();
+            read.rate = rate ? rate.Value() : 0.0;
+            auto shuffle = info.IsShuffleActive();
+            read.shuffle = shuffle ? (shuffle.Value() ? 1 : 0) : -1;
+            auto repeat = info.AutoRepeatMode();
+            read.repeatMode = repeat ? static_cast<int32_t>(repeat.Value()) : -1;
+            if (auto controls = info.Controls()) {
+                if (controls.IsPlayEnabled()) read.controls |= SMTC_Control_Play;
+                if (controls.IsPauseEnabled()) read.controls |= SMTC_Control_Pause;
+                if (controls.IsStopEnabled()) read.controls |= SMTC_Control_Stop;
+                if (controls.IsNextEnabled()) read.controls |= SMTC_Control_Next;
+                if (controls.IsPreviousEnabled()) read.controls |= SMTC_Control_Previous;
+                if (controls.IsPlayPauseToggleEnabled()) read.controls |= SMTC_Control_PlayPauseToggle;
+                if (controls.IsPlaybackPositionEnabled()) read.controls |= SMTC_Control_PlaybackPosition;
+                if (controls.IsShuffleEnabled()) read.controls |= SMTC_Control_Shuffle;
+                if (controls.IsRepeatEnabled()) read.controls |= SMTC_Control_Repeat;
+                if (controls.IsPlaybackRateEnabled()) read.controls |= SMTC_Control_PlaybackRate;
+            }
+        }
+    }
+    catch (...) {}
+    return read;
+}
+
+struct WinRTMediaSession : IMediaSession {
+    GlobalSystemMediaTransportControlsSession session;
+    winrt::event_token mediaPropertiesToken{};
+    winrt::event_token timelinePropertiesToken{};
+    winrt::event_token playbackInfoToken{};
+
+    explicit WinRTMediaSession(GlobalSystemMediaTransportControlsSession s) : session(std::move(s)) {}
+    ~WinRTMediaSession() override { Unsubscribe(); }
+
+    std::wstring SourceAppId() override {
+        try { return std::wstring(session.SourceAppUserModelId().c_str()); }
+        catch (...) { return std::wstring(); }
+    }
+
+    void Subscribe(MediaSessionEvents events) override {
+        Unsubscribe();
+        try {
+            mediaPropertiesToken = session.MediaPropertiesChanged([handler = std::move(events.mediaPropertiesChanged)](auto&&, auto&&) { handler(); });
+            timelinePropertiesToken = session.TimelinePropertiesChanged([handler = std::move(events.timelineChanged)](auto&&, auto&&) { handler(); });
+            playbackInfoToken = session.PlaybackInfoChanged([handler = std::move(events.playbackInfoChanged)](auto&&, auto&&) { handler(); });
         }
-        if (!g_isRunning.load()) { uninit_apartment(); return; }
+        catch (...) {}
+    }
+
+    void Unsubscribe() override {
+        if (mediaPropertiesToken.value) { try { session.MediaPropertiesChanged(mediaPropertiesToken); } catch (...) {} mediaPropertiesToken = {}; }
+        if (timelinePropertiesToken.value) { try { session.TimelinePropertiesChanged(timelinePropertiesToken); } catch (...) {} timelinePropertiesToken = {}; }
+        if (playbackInfoToken.value) { try { session.PlaybackInfoChanged(playbackInfoToken); } catch (...) {} playbackInfoToken = {}; }
+    }
 
-        g_manager = op.GetResults();
-        if (!g_manager) { uninit_apartment(); return; }
+    AsyncRead<MediaPropertiesSnapshot> ReadMediaProperties() override {
+        AsyncRead<MediaPropertiesSnapshot> read;
+        try {
+            auto async = session.TryGetMediaPropertiesAsync();
+            read.OnCancel([async]() { try { async.Cancel(); } catch (...) {} });
+            async.Completed([read](auto const& op, AsyncStatus status) {
+                MediaPropertiesSnapshot snapshot;
+                if (status == AsyncStatus::Completed) {
+                    try { snapshot = ToSnapshot(op.GetResults()); }
+                    catch (...) {}
+                }
+                read.Complete(std::move(snapshot));
+                });
+        }
+        catch (...) { read.Complete(MediaPropertiesSnapshot{}); }
+        return read;
+    }
+
+    AsyncRead<TimelineSnapshot> ReadTimeline() override {
+        AsyncRead<TimelineSnapshot> read;
+        RunInThreadPool([read, s = session]() { read.Complete(ReadTimelineSnapshot(s)); });
+        return read;
+    }
+
+    AsyncRead<PlaybackSnapshot> ReadPlaybackInfo() override {
+        AsyncRead<PlaybackSnapshot> read;
+        RunInThreadPool([read, s = session]() { read.Complete(ReadPlaybackSnapshot(s)); });
+        return read;
+    }
 
-        // ע manager.CurrentSessionChanged ¼
-        winrt::weak_ref<GlobalSystemMediaTransportControlsSessionManager> weakManager{ g_manager };
-        g_sessionChangedToken = g_manager.CurrentSessionChanged([weakManager](auto&&, auto&&) {
-            EnqueueTask([weakManager]() { if (auto mgr = weakManager.get()) { OnSessionManagerChanged_Internal(); } });
+#if SMTC_FEATURE_CONTROLS
+    void SendCommand(MediaCommand command) override {
+        try {
+            switch (command) {
+            case MediaCommand::PlayPause: session.TryTogglePlayPauseAsync(); break;
+            case MediaCommand::Play: session.TryPlayAsync(); break;
+            case MediaCommand::Pause: session.TryPauseAsync(); break;
+            case MediaCommand::Next: session.TrySkipNextAsync(); break;
+            case MediaCommand::Previous: session.TrySkipPreviousAsync(); break;
+            }
+        }
+        catch (...) {}
+    }
+    void ChangePosition(int64_t positionTicks) override {
+        try { session.TryChangePlaybackPositionAsync(positionTicks); }
+        catch (...) {}
+    }
+#endif
+};
+
+struct WinRTMediaBackend : IMediaBackend {
+    GlobalSystemMediaTransportControlsSessionManager manager = nullptr;
+    winrt::event_token sessionChangedToken{};
+
+    bool Start(const std::function<bool()>& shouldStop) override {
+        try {
+            auto op = GlobalSystemMediaTransportControlsSessionManager::RequestAsync();
+            while (op.Status() == AsyncStatus::Started && !shouldStop()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            if (shouldStop()) return false;
+            manager = op.GetResults();
+        }
+        catch (...) { manager = nullptr; }
+        return static_cast<bool>(manager);
+    }
+
+    void Stop() override {
+        if (manager && sessionChangedToken.value) { try { manager.CurrentSessionChanged(sessionChangedToken); } catch (...) {} }
+        sessionChangedToken = {};
+        manager = nullptr;
+    }
+
+    void SubscribeSessionChanged(std::function<void()> handler) override {
+        try { sessionChangedToken = manager.CurrentSessionChanged([handler = std::move(handler)](auto&&, auto&&) { handler(); }); }
+        catch (...) {}
+    }
+
+    std::shared_ptr<IMediaSession> PickSession() override {
+        GlobalSystemMediaTransportControlsSession bestSession = nullptr;
+        try {
+            auto sessions = manager.GetSessions();
+            for (auto const& s : sessions) {
+                try {
+                    auto info = s.GetPlaybackInfo();
+                    if (info && info.PlaybackStatus() == GlobalSystemMediaTransportControlsSessionPlaybackStatus::Playing) {
+                        bestSession = s;
+                        break;
+                    }
+                }
+                catch (...) {}
+            }
+            if (!bestSession) {
+                bestSession = manager.GetCurrentSession();
+            }
+        }
+        catch (...) {}
+        if (!bestSession) return nullptr;
+        return std::make_shared<WinRTMediaSession>(bestSession);
+    }
+};
+
+static std::shared_ptr<IMediaBackend> CreateWinRTBackend() { return std::make_shared<WinRTMediaBackend>(); }
+#endif
+
+// ================= Update  Worker ִ߳У =================
+// Ϊ˲Э̣ÿ co_await OnWorker ֮󶼻ص Worker ȡʱڸô
+// origin ζȡĺ¼ʱ䣬 TriggerCallback ͳ¼Ͷӳ
+static BackendOp UpdateMediaProperties(SMTC_Context* ctx, std::shared_ptr<IMediaSession> session, TimerClock::time_point origin) {
+    MediaPropertiesSnapshot props = co_await OnWorker(session->ReadMediaProperties());
+    if (!props.valid) co_return;
+
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lk(ctx->dataMutex);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_Title, ctx->title, props.title);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_Artist, ctx->artist, props.artist);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_AlbumTitle, ctx->albumTitle, props.albumTitle);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_AlbumArtist, ctx->albumArtist, props.albumArtist);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_Genres, ctx->genres, props.genres);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_TrackNumber, ctx->trackNumber, props.trackNumber);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_AlbumTrackCount, ctx->albumTrackCount, props.albumTrackCount);
+    }
+
+#if SMTC_FEATURE_COVER
+    // 棺ʱ򿪣С޻ڴԤʱڶȡǰֻɷ
+    std::shared_ptr<IMediaThumbnail> thumbnail = std::move(props.thumbnail);
+    if (thumbnail && !ctx->suspended.load()) {
+        std::optional<uint64_t> coverSize = co_await OnWorker(thumbnail->Open());
+        if (coverSize) {
+            bool allowed;
+            {
+                std::lock_guard<std::mutex> lk(ctx->dataMutex);
+                allowed = *coverSize <= UINT32_MAX && CoverAllowed_Locked(ctx, *coverSize);
+                if (!allowed) changed |= DropCover_Locked(ctx);
+            }
+
+            if (allowed) {
+                std::optional<std::vector<uint8_t>> bytes = co_await OnWorker(thumbnail->Read());
+                thumbnail.reset();
+
+                if (bytes) {
+                    uint64_t newHash = HashBytes(*bytes);
+                    std::lock_guard<std::mutex> lk(ctx->dataMutex);
+                    // ڱ仯ʱطͬһŷ棬ϣͬΪ仯
+                    if (!CoverAllowed_Locked(ctx, bytes->size())) {
+                        // ȡڼԤ㱻ͻ
+                        changed |= DropCover_Locked(ctx);
+                        ctx->coversSkipped.fetch_add(1);
+                    }
+                    else if (newHash != ctx->coverHash || bytes->size() != ctx->coverBuffer.size()) {
+                        ctx->coverBuffer = std::move(*bytes);
+                        ctx->coverHash = newHash;
+                        ctx->hasNewCover = true;
+                        ctx->fieldVersions[SMTC_Field_Cover] = ++ctx->dataVersion;
+                        changed = true; // 仯Ҳ MediaPropertiesChanged
+                    }
+                }
+            }
+            else {
+                ctx->coversSkipped.fetch_add(1);
+            }
+        }
+    }
+    else {
+        if (thumbnail) ctx->coversSkipped.fetch_add(1);
+        std::lock_guard<std::mutex> lk(ctx->dataMutex);
+        changed |= DropCover_Locked(ctx);
+    }
+#endif
+
+    if (changed) {
+        ctx->isDataDirty.store(true);
+        TriggerCallback(ctx, SMTC_EventType::MediaPropertiesChanged, origin);
+    }
+}
+
+enum class TimelineRead {
+    Event, // ʱ¼ʼȡ֮¿ʼĬʱ
+    Poll   // ѯˣ֮Ƿ仯һѯ
+};
+
+static void ArmTimelinePoll(SMTC_Context* ctx);
+static void ContinueTimelinePoll(SMTC_Context* ctx, bool changed);
+
+static BackendOp UpdateTimeline(SMTC_Context* ctx, std::shared_ptr<IMediaSession> session, TimelineRead reason, TimerClock::time_point origin) {
+    TimelineSnapshot snapshot = co_await OnWorker(session->ReadTimeline());
+
+    bool changed = false;
+    if (snapshot.valid) {
+        {
+            std::lock_guard<std::mutex> lk(ctx->dataMutex);
+            changed |= UpdateField_Locked(ctx, SMTC_Field_Position, ctx->positionTicks, snapshot.positionTicks);
+            changed |= UpdateField_Locked(ctx, SMTC_Field_Duration, ctx->durationTicks, snapshot.durationTicks);
+        }
+        if (changed) {
+            ctx->isDataDirty.store(true);
+            TriggerCallback(ctx, SMTC_EventType::TimelineChanged, origin);
+        }
+    }
+
+    if (reason == TimelineRead::Poll) {
+        ContinueTimelinePoll(ctx, changed);
+    }
+    else {
+        ArmTimelinePoll(ctx);
+    }
+}
+
+// ================= ʱѯ =================
+// /沥Ӳ TimelinePropertiesChangedpositionTicks һֱͣ״ζȡֵ
+//  kTimelineSilenceThreshold δյʱ¼Ϊʱȡ
+//   - ֵб仯ʱص̼ޱ仯ʱֱޣ
+//   - ӽĿβʱսԱ㼰ʱӳи裻
+//   - ֹͣͣл session ʱֹͣѯ
+// ÿյʵʱ¼ѯƳٵһĬ֮¼Ĳᱻѯ
+static const std::chrono::milliseconds kTimelineSilenceThreshold{ 3000 };
+static const std::chrono::milliseconds kTimelinePollMinInterval{ 1000 };
+static const std::chrono::milliseconds kTimelinePollMaxInterval{ 8000 };
+static const std::chrono::milliseconds kTimelinePollNearEndInterval{ 250 };
+static const int64_t kTimelineNearEndTicks = 5LL * 10000000LL; // 5 루100ns/tick
+
+static void TimelinePollTick(SMTC_Context* ctx);
+
+static void StopTimelinePoll(SMTC_Context* ctx) {
+    CancelKeyedTimer(ctx, TimerKey::TimelinePoll);
+    ctx->timelinePollInterval = kTimelinePollMinInterval;
+}
+
+// £ʼĬʱڲвŻᰲѯ
+static void ArmTimelinePoll(SMTC_Context* ctx) {
+    bool isPlaying;
+    { std::lock_guard<std::mutex> lk(ctx->dataMutex); isPlaying = ctx->isPlaying; }
+    if (!isPlaying || !ctx->currentSession) { StopTimelinePoll(ctx); return; }
+
+    ctx->timelinePollInterval = kTimelinePollMinInterval;
+    ScheduleKeyedTimer(ctx, TimerKey::TimelinePoll, kTimelineSilenceThreshold, [ctx]() { TimelinePollTick(ctx); });
+}
+
+static void TimelinePollTick(SMTC_Context* ctx) {
+    bool isPlaying;
+    { std::lock_guard<std::mutex> lk(ctx->dataMutex); isPlaying = ctx->isPlaying; }
+    if (!isPlaying || !ctx->currentSession) { StopTimelinePoll(ctx); return; }
+
+    SpawnBackendOp(ctx, OpLane::Timeline, UpdateTimeline(ctx, ctx->currentSession, TimelineRead::Poll, TimerClock::time_point{}), true);
+}
+
+// ѯȡɺһ
+static void ContinueTimelinePoll(SMTC_Context* ctx, bool changed) {
+    bool isPlaying;
+    { std::lock_guard<std::mutex> lk(ctx->dataMutex); isPlaying = ctx->isPlaying; }
+    if (!isPlaying || !ctx->currentSession) { StopTimelinePoll(ctx); return; }
+
+    if (changed) {
+        ctx->timelinePollInterval = kTimelinePollMinInterval;
+    }
+    else {
+        ctx->timelinePollInterval = std::min(ctx->timelinePollInterval * 2, kTimelinePollMaxInterval);
+    }
+
+    std::chrono::milliseconds next = ctx->timelinePollInterval;
+    {
+        std::lock_guard<std::mutex> lk(ctx->dataMutex);
+        if (ctx->durationTicks > 0 && ctx->durationTicks - ctx->positionTicks < kTimelineNearEndTicks) {
+            next = kTimelinePollNearEndInterval;
+        }
+    }
+    ScheduleKeyedTimer(ctx, TimerKey::TimelinePoll, next, [ctx]() { TimelinePollTick(ctx); });
+}
+
+static BackendOp UpdatePlaybackInfo(SMTC_Context* ctx, std::shared_ptr<IMediaSession> session, TimerClock::time_point origin) {
+    PlaybackSnapshot snapshot = co_await OnWorker(session->ReadPlaybackInfo());
+    if (!snapshot.valid) co_return;
+
+    bool changed = false;
+    bool playingChanged = false;
+    {
+        std::lock_guard<std::mutex> lk(ctx->dataMutex);
+        if (ctx->isPlaying != snapshot.isPlaying) {
+            ctx->isPlaying = snapshot.isPlaying;
+            playingChanged = true;
+        }
+        changed |= UpdateField_Locked(ctx, SMTC_Field_PlaybackStatus, ctx->playbackStatus, snapshot.status);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_PlaybackType, ctx->playbackType, snapshot.type);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_PlaybackRate, ctx->playbackRate, snapshot.rate);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_Shuffle, ctx->shuffle, snapshot.shuffle);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_RepeatMode, ctx->repeatMode, snapshot.repeatMode);
+        changed |= UpdateField_Locked(ctx, SMTC_Field_EnabledControls, ctx->enabledControls, snapshot.controls);
+    }
+    if (changed || playingChanged) {
+        ctx->isDataDirty.store(true);
+        TriggerCallback(ctx, SMTC_EventType::PlaybackStatusChanged, origin);
+    }
+    if (playingChanged) {
+        ArmTimelinePoll(ctx); // ʼʱĬʱͣʱֹͣѯ
+    }
+}
+
+static const std::chrono::milliseconds kMediaPropertiesDebounce{ 50 };
+
+// ¼̴ֻ߳ session  weak_ptrٺ󵽴¼ֱӶ
+// ע;ľ session ¼ص Worker ʱѲǵǰ sessionͬ
+static std::shared_ptr<IMediaSession> LockCurrentSession(SMTC_Context* ctx, const std::weak_ptr<IMediaSession>& weakSession) {
+    auto session = weakSession.lock();
+    return (session && session == ctx->currentSession) ? session : nullptr;
+}
+
+static void SetupSessionEvents_Internal(SMTC_Context* ctx, const std::shared_ptr<IMediaSession>& session, TimerClock::time_point origin) {
+    if (!session) return;
+    std::weak_ptr<IMediaSession> weakSession = session;
+    std::weak_ptr<SMTC_Context> weakCtx = ctx->weak_from_this();
+
+    MediaSessionEvents events;
+    // иʱ MediaPropertiesChangedֻȡһΣظȡ棩
+    events.mediaPropertiesChanged = [weakCtx, weakSession]() {
+        auto ctx = weakCtx.lock();
+        if (!ctx) return;
+        auto origin = TimerClock::now();
+        ScheduleKeyedTimer(ctx.get(), TimerKey::MediaProperties, kMediaPropertiesDebounce, [weakCtx, weakSession, origin]() {
+            auto ctx = weakCtx.lock();
+            if (!ctx) return;
+            if (auto strong = LockCurrentSession(ctx.get(), weakSession)) { SpawnBackendOp(ctx.get(), OpLane::MediaProperties, UpdateMediaProperties(ctx.get(), strong, origin), true); }
+            });
+        };
+    events.timelineChanged = [weakCtx, weakSession]() {
+        auto ctx = weakCtx.lock();
+        if (!ctx) return;
+        SMTC_Context* raw = ctx.get();
+        auto origin = TimerClock::now();
+        EnqueueTask(raw, [raw, weakSession, origin]() { if (auto strong = LockCurrentSession(raw, weakSession)) { SpawnBackendOp(raw, OpLane::Timeline, UpdateTimeline(raw, strong, TimelineRead::Event, origin), true); } });
+        };
+    events.playbackInfoChanged = [weakCtx, weakSession]() {
+        auto ctx = weakCtx.lock();
+        if (!ctx) return;
+        SMTC_Context* raw = ctx.get();
+        auto origin = TimerClock::now();
+        EnqueueTask(raw, [raw, weakSession, origin]() { if (auto strong = LockCurrentSession(raw, weakSession)) { SpawnBackendOp(raw, OpLane::PlaybackInfo, UpdatePlaybackInfo(raw, strong, origin), true); } });
+        };
+    session->Subscribe(std::move(events));
+
+    // һγʼȡȡͬ laneͬʱУʱȡɺῪʼĬʱ
+    EnqueueTask(ctx, [ctx, weakSession, origin]() {
+        if (auto strong = LockCurrentSession(ctx, weakSession)) {
+            SpawnBackendOp(ctx, OpLane::MediaProperties, UpdateMediaProperties(ctx, strong, origin), true);
+            SpawnBackendOp(ctx, OpLane::Timeline, UpdateTimeline(ctx, strong, TimelineRead::Event, origin), true);
+            SpawnBackendOp(ctx, OpLane::PlaybackInfo, UpdatePlaybackInfo(ctx, strong, origin), true);
+        }
+        });
+}
+
+
+static void OnSessionManagerChanged_Internal(SMTC_Context* ctx, TimerClock::time_point origin) {
+    if (!ctx->backend) return;
+    if (ctx->isChangingSession) return;
+    ctx->isChangingSession = true;
+
+    UnregisterCurrentSessionEvents(ctx);
+    CancelBackendOps(ctx); //  session Ķȡ
+    CancelKeyedTimer(ctx, TimerKey::MediaProperties);
+    StopTimelinePoll(ctx);
+#if SMTC_FEATURE_SESSION_VOLUME
+    StopVolumeFade(ctx); // еǾɲƵỰ
+#endif
+    ctx->currentSession = nullptr;
+
+    std::shared_ptr<IMediaSession> bestSession;
+    try { bestSession = ctx->backend->PickSession(); }
+    catch (...) {}
+
+    ctx->currentSession = bestSession;
+    if (ctx->currentSession) {
+        SetupSessionEvents_Internal(ctx, ctx->currentSession, origin);
+        // ȷ״μҲ¼Ϊ SetupSessionEvents_Internal  Enqueue ʼȡ
+    }
+
+    ctx->isChangingSession = false;
+
+    // **Session лɣ֪ͨⲿ**
+    ctx->isDataDirty.store(true);
+    TriggerCallback(ctx, SMTC_EventType::SessionChanged, origin);
+}
+
+
+static void WorkerThreadFunc(SMTC_Context* ctx) {
+#if SMTC_PLATFORM_WINDOWS
+    init_apartment();
+    struct ApartmentGuard { ~ApartmentGuard() { uninit_apartment(); } } apartment;
+
+    if (!ctx->backend) ctx->backend = CreateWinRTBackend();
+#endif
+    if (!ctx->backend) return; //  Windows ƽ̨ûĬϺ
+
+    // ˣWinRT ʵֻ SessionManager
+    try {
+        IMediaBackend* backend = ctx->backend.get();
+        if (!backend->Start([ctx]() { return !ctx->isRunning.load(); })) return;
+
+        // ע session л¼
+        std::weak_ptr<SMTC_Context> weakCtx = ctx->weak_from_this();
+        backend->SubscribeSessionChanged([weakCtx]() {
+            auto ctx = weakCtx.lock();
+            if (!ctx) return;
+            SMTC_Context* raw = ctx.get();
+            auto origin = TimerClock::now();
+            EnqueueTask(raw, [raw, origin]() { OnSessionManagerChanged_Internal(raw, origin); });
             });
 
         // ״ִһ
-        EnqueueTask([]() { OnSessionManagerChanged_Internal(); });
+        auto startTime = TimerClock::now();
+        EnqueueTask(ctx, [ctx, startTime]() { OnSessionManagerChanged_Internal(ctx, startTime); });
 
-        // ѭȴִ
-        while (g_isRunning.load()) {
+        // ѭִǵڵĶʱûʱ˯ĵʱ
+        while (ctx->isRunning.load()) {
             std::function<void()> task;
+            TimerClock::time_point readyTime;
             {
-                std::unique_lock<std::mutex> lk(g_queueMutex);
-                if (g_taskQueue.empty()) {
-                    g_queueCv.wait_for(lk, std::chrono::milliseconds(200));
-                }
-                if (!g_taskQueue.empty()) {
-                    task = std::move(g_taskQueue.front());
-                    g_taskQueue.pop();
+                std::unique_lock<std::mutex> lk(ctx->queueMutex);
+                while (ctx->isRunning.load()) {
+                    if (!ctx->taskQueue.empty()) {
+                        task = std::move(ctx->taskQueue.front().task);
+                        readyTime = ctx->taskQueue.front().enqueueTime;
+                        ctx->taskQueue.pop();
+                        break;
+                    }
+                    TimerClock::time_point nextDeadline;
+                    if (PopDueTimer_Locked(ctx, task, readyTime, nextDeadline)) {
+                        ctx->stats.timersFired.fetch_add(1, std::memory_order_relaxed);
+                        break;
+                    }
+                    if (nextDeadline == TimerClock::time_point::max()) {
+                        ctx->queueCv.wait(lk);
+                    }
+                    else {
+                        ctx->queueCv.wait_until(lk, nextDeadline);
+                    }
                 }
             }
 
             if (task) {
+                auto start = TimerClock::now();
+                ctx->stats.queueLatency.Record(start - readyTime);
                 try { task(); }
                 catch (...) {}
+                ctx->stats.taskDuration.Record(TimerClock::now() - start);
+                ctx->stats.tasksExecuted.fetch_add(1, std::memory_order_relaxed);
             }
         }
 
-        // ˳ǰע session  manager ¼
+        // ˳ǰȵȴ;ĺ˲ע session ¼ֹͣ
+        DrainBackendOps(ctx);
         try {
-            UnregisterCurrentSessionEvents();
-            if (g_sessionChangedToken.value) { try { g_manager.CurrentSessionChanged(g_sessionChangedToken); } catch (...) {} g_sessionChangedToken = {}; }
+#if SMTC_FEATURE_SESSION_VOLUME
+            StopVolumeFade(ctx);
+#endif
+            ClearTimers(ctx);
+            UnregisterCurrentSessionEvents(ctx);
+            backend->Stop();
         }
         catch (...) {}
 
-        g_manager = nullptr;
-        g_currentSession = nullptr;
+        ctx->currentSession = nullptr;
     }
     catch (...) {}
+}
 
-    uninit_apartment();
+// =================  =================
+static void StartContext(SMTC_Context* ctx) {
+    std::lock_guard<std::mutex> lifecycle(ctx->lifecycleMutex);
+    if (ctx->isRunning.load()) { return; }
+    ctx->isRunning.store(true);
+    ctx->workerThread = std::thread([ctx]() { WorkerThreadFunc(ctx); });
 }
 
+static void StopContext(SMTC_Context* ctx) {
+    std::lock_guard<std::mutex> lifecycle(ctx->lifecycleMutex);
+    if (!ctx->isRunning.load()) { return; }
+    StopIpcServer(ctx); // ȶϿĿͻˣ֮Զ
+    ctx->isRunning.store(false);
+    // Worker ڵȴһʱȻȡһ֪ͨ isRunning  wait ֮䶪ʧ
+    { std::lock_guard<std::mutex> lk(ctx->queueMutex); }
+    ctx->queueCv.notify_one();
+    if (ctx->workerThread.joinable()) { try { ctx->workerThread.join(); } catch (...) {} }
+    {
+        // δִе񣬱һ Start ʱִһ
+        std::lock_guard<std::mutex> lk(ctx->queueMutex);
+        ctx->taskQueue = {};
+    }
+    {
+        std::lock_guard<std::mutex> lk(ctx->dataMutex);
+        ctx->title.clear(); ctx->artist.clear(); ctx->positionTicks = 0; ctx->durationTicks = 0; ctx->isPlaying = false;
+        ctx->albumTitle.clear(); ctx->albumArtist.clear(); ctx->genres.clear(); ctx->trackNumber = 0; ctx->albumTrackCount = 0;
+        ctx->playbackType = -1; ctx->playbackStatus = -1; ctx->playbackRate = 0.0; ctx->shuffle = -1; ctx->repeatMode = -1; ctx->enabledControls = 0;
+#if SMTC_FEATURE_COVER
+        std::vector<uint8_t>().swap(ctx->coverBuffer); ctx->coverHash = 0; ctx->hasNewCover = false;
+#endif
+        MarkAllFieldsChanged_Locked(ctx); // 汾Ų㣬оɰ汾ŵĵ÷ῴȫֶѱ仯
+    }
+    {
+        std::lock_guard<std::mutex> lk(ctx->callbackMutex);
+        ctx->externalCallback = nullptr; // ص
+        ctx->contextCallback = nullptr;
+        ctx->contextCallbackUserData = nullptr;
+    }
+}
 
-// ================= ӿ =================
+// SMTC_Create Уָ룬SMTC_Destroy ʱƳ
+static std::mutex g_contextsMutex;
+static std::vector<std::shared_ptr<SMTC_Context>> g_contexts;
 
-// **ע C# ص**
-extern "C" __declspec(dllexport) void RegisterUpdateCallback(SMTC_UpdateCallback callback) {
-    // 򵥵ر溯ָ룬Ҫ̰߳ȫΪֻ worker ̻߳
-    g_externalCallback = callback;
+// ɵ޾ӿʹõĬģ̴ڣɱ SMTC_Destroy ͷ
+static SMTC_Context* DefaultContext() {
+    static std::shared_ptr<SMTC_Context> defaultContext = std::make_shared<SMTC_Context>();
+    return defaultContext.get();
 }
 
-// **ݱ仯־**
-extern "C" __declspec(dllexport) void SMTC_ClearDataDirtyFlag() {
-    g_isDataDirty.store(false);
+#if SMTC_FEATURE_CONTROLS
+static void EnqueueControl(SMTC_Context* ctx, std::function<void(IMediaSession&)> fn) {
+    EnqueueTask(ctx, [ctx, fn]() {
+        if (ctx->currentSession) {
+            try { fn(*ctx->currentSession); }
+            catch (...) {}
+        }
+        });
 }
+#endif
 
-// **Ƿݱ仯**
-extern "C" __declspec(dllexport) bool SMTC_IsDataDirty() {
-    return g_isDataDirty.load();
-}
 
+// ================= ӿڣģ =================
 
-extern "C" __declspec(dllexport) void InitSMTC() {
-    bool expected = false;
-    if (!g_isRunning.compare_exchange_strong(expected, true)) { return; }
-    g_workerThread = std::thread([]() { WorkerThreadFunc(); });
+// һŽģصľͨ SMTC_Destroy ͷ
+SMTC_API SMTC_Context* SMTC_Create() {
+    auto ctx = std::make_shared<SMTC_Context>();
+    {
+        std::lock_guard<std::mutex> lk(g_contextsMutex);
+        g_contexts.push_back(ctx);
+    }
+    StartContext(ctx.get());
+    return ctx.get();
 }
 
-extern "C" __declspec(dllexport) void ShutdownSMTC() {
-    bool expected = true;
-    if (!g_isRunning.compare_exchange_strong(expected, false)) { return; }
-    g_queueCv.notify_one();
-    if (g_workerThread.joinable()) { try { g_workerThread.join(); } catch (...) {} }
+// ֹͣĵ Worker ̲߳ͷȫԴúʧЧ
+SMTC_API void SMTC_Destroy(SMTC_Context* context) {
+    if (!context) return;
+    std::shared_ptr<SMTC_Context> owned;
     {
-        std::lock_guard<std::mutex> lk(g_dataMutex);
-        g_title.clear(); g_artist.clear(); g_coverBuffer.clear(); g_positionTicks = 0; g_durationTicks = 0; g_isPlaying = false; g_hasNewCover = false;
+        std::lock_guard<std::mutex> lk(g_contextsMutex);
+        auto it = std::find_if(g_contexts.begin(), g_contexts.end(), [context](const std::shared_ptr<SMTC_Context>& c) { return c.get() == context; });
+        if (it == g_contexts.end()) return;
+        owned = std::move(*it);
+        g_contexts.erase(it);
     }
-    g_externalCallback = nullptr; // ص
+    StopContext(owned.get());
 }
 
+SMTC_API void SMTC_CtxRegisterCallback(SMTC_Context* context, SMTC_ContextCallback callback, void* userData) {
+    if (!context) return;
+    std::lock_guard<std::mutex> lk(context->callbackMutex);
+    context->contextCallback = callback;
+    context->contextCallbackUserData = userData;
+}
 
+SMTC_API void SMTC_CtxClearDataDirtyFlag(SMTC_Context* context) {
+    if (!context) return;
+    context->isDataDirty.store(false);
+}
 
-static void EnqueueControl(std::function<void(GlobalSystemMediaTransportControlsSession)> fn) {
-    EnqueueTask([fn]() {
-        if (g_currentSession) {
-            try { fn(g_currentSession); }
-            catch (...) {}
-        }
-        });
+SMTC_API bool SMTC_CtxIsDataDirty(SMTC_Context* context) {
+    if (!context) return false;
+    return context->isDataDirty.load();
 }
-extern "C" __declspec(dllexport) void SMTC_PlayPause() { EnqueueControl([](auto session) { session.TryTogglePlayPauseAsync(); }); }
-extern "C" __declspec(dllexport) void SMTC_Play() { EnqueueControl([](auto session) { session.TryPlayAsync(); }); }
-extern "C" __declspec(dllexport) void SMTC_Pause() { EnqueueControl([](auto session) { session.TryPauseAsync(); }); }
-extern "C" __declspec(dllexport) void SMTC_Next() { EnqueueControl([](auto session) { session.TrySkipNextAsync(); }); }
-extern "C" __declspec(dllexport) void SMTC_Previous() { EnqueueControl([](auto session) { session.TrySkipPreviousAsync(); }); }
 
+#if SMTC_FEATURE_CONTROLS
+SMTC_API void SMTC_CtxPlayPause(SMTC_Context* context) { if (context) EnqueueControl(context, [](IMediaSession& session) { session.SendCommand(MediaCommand::PlayPause); }); }
+SMTC_API void SMTC_CtxPlay(SMTC_Context* context) { if (context) EnqueueControl(context, [](IMediaSession& session) { session.SendCommand(MediaCommand::Play); }); }
+SMTC_API void SMTC_CtxPause(SMTC_Context* context) { if (context) EnqueueControl(context, [](IMediaSession& session) { session.SendCommand(MediaCommand::Pause); }); }
+SMTC_API void SMTC_CtxNext(SMTC_Context* context) { if (context) EnqueueControl(context, [](IMediaSession& session) { session.SendCommand(MediaCommand::Next); }); }
+SMTC_API void SMTC_CtxPrevious(SMTC_Context* context) { if (context) EnqueueControl(context, [](IMediaSession& session) { session.SendCommand(MediaCommand::Previous); }); }
+#endif
+
+#if SMTC_FEATURE_SESSION_VOLUME
 // ޸ĺƣƲ˵ϵͳ
-extern "C" __declspec(dllexport) void SMTC_VolumeUp() { 
-    EnqueueTask([]() { 
-        try { 
-            ChangeSessionVolumeBy(0.05);
-        } catch (...) {} 
-    }); 
-}
-extern "C" __declspec(dllexport) void SMTC_VolumeDown() { 
-    EnqueueTask([]() { 
-        try { 
-            ChangeSessionVolumeBy(-0.05);
-        } catch (...) {} 
-    }); 
-}
-extern "C" __declspec(dllexport) void SMTC_SetVolume(float volume) {
-    EnqueueTask([volume]() {
-        try { 
-            SetSessionVolumeByProcess(volume);
-        } catch (...) {} 
+SMTC_API void SMTC_CtxVolumeUp(SMTC_Context* context) {
+    if (!context) return;
+    EnqueueTask(context, [context]() {
+        try {
+            SpawnBackendOp(context, OpLane::Volume, ChangeVolume(context, context->currentSession, 0.05f, true));
+        } catch (...) {}
     });
 }
+SMTC_API void SMTC_CtxVolumeDown(SMTC_Context* context) {
+    if (!context) return;
+    EnqueueTask(context, [context]() {
+        try {
+            SpawnBackendOp(context, OpLane::Volume, ChangeVolume(context, context->currentSession, -0.05f, true));
+        } catch (...) {}
+    });
+}
+SMTC_API void SMTC_CtxSetVolume(SMTC_Context* context, float volume) {
+    if (!context) return;
+    EnqueueTask(context, [context, volume]() {
+        try {
+            SpawnBackendOp(context, OpLane::Volume, ChangeVolume(context, context->currentSession, volume, false));
+        } catch (...) {}
+    });
+}
+//  durationMs ڽ䵽 volume (0.0-1.0)
+SMTC_API void SMTC_CtxFadeVolume(SMTC_Context* context, float volume, int durationMs) {
+    if (!context) return;
+    EnqueueTask(context, [context, volume, durationMs]() {
+        try {
+            SpawnBackendOp(context, OpLane::Volume, StartVolumeFade(context, context->currentSession, volume, durationMs));
+        } catch (...) {}
+    });
+}
+#endif
 
-
-extern "C" __declspec(dllexport) int SMTC_GetTitle(char* buffer, int len) {
-    if (!buffer || len <= 0) return 0;
-    std::lock_guard<std::mutex> lk(g_dataMutex);
-    if (g_title.empty()) return 0;
-    int copyLen = std::min<int>(len - 1, (int)g_title.size());
-    memcpy(buffer, g_title.data(), copyLen);
+#if SMTC_FEATURE_MASTER_VOLUME
+// ϵͳĬ豸벥໥
+SMTC_API void SMTC_CtxSetSystemVolume(SMTC_Context* context, float volume) {
+    if (!context) return;
+    EnqueueTask(context, [context, volume]() {
+        try {
+            SpawnBackendOp(context, OpLane::Volume, ChangeSystemVolume(volume, false));
+        } catch (...) {}
+    });
+}
+SMTC_API void SMTC_CtxChangeSystemVolume(SMTC_Context* context, float delta) {
+    if (!context) return;
+    EnqueueTask(context, [context, delta]() {
+        try {
+            SpawnBackendOp(context, OpLane::Volume, ChangeSystemVolume(delta, true));
+        } catch (...) {}
+    });
+}
+#endif
+
+SMTC_API int SMTC_CtxGetTitle(SMTC_Context* context, char* buffer, int len) {
+    if (!context || !buffer || len <= 0) return 0;
+    ScopedLatency latency(context->stats.getterLatency);
+    std::lock_guard<std::mutex> lk(context->dataMutex);
+    if (context->title.empty()) return 0;
+    int copyLen = std::min<int>(len - 1, (int)context->title.size());
+    memcpy(buffer, context->title.data(), copyLen);
     buffer[copyLen] = '\0';
     return copyLen;
 }
-extern "C" __declspec(dllexport) int SMTC_GetArtist(char* buffer, int len) { /* ... ԭʵ ... */
-    if (!buffer || len <= 0) return 0; std::lock_guard<std::mutex> lk(g_dataMutex); if (g_artist.empty()) return 0;
-    int copyLen = std::min<int>(len - 1, (int)g_artist.size()); memcpy(buffer, g_artist.data(), copyLen); buffer[copyLen] = '\0'; return copyLen;
-}
-extern "C" __declspec(dllexport) bool SMTC_GetPlaybackStatus() {
-    std::lock_guard<std::mutex> lk(g_dataMutex);
-    return g_isPlaying;
-}
-extern "C" __declspec(dllexport) void SMTC_GetTimeline(long long* position, long long* duration) {
-    if (!position || !duration) return;
-    std::lock_guard<std::mutex> lk(g_dataMutex);
-    *position = g_positionTicks;
-    *duration = g_durationTicks;
-}
-extern "C" __declspec(dllexport) int SMTC_GetCoverImage(uint8_t* buffer, int len) {
-    if (!buffer || len <= 0) return 0;
-    std::lock_guard<std::mutex> lk(g_dataMutex);
-    if (g_coverBuffer.empty()) return 0;
-    int copyLen = std::min<int>(len, (int)g_coverBuffer.size());
-    memcpy(buffer, g_coverBuffer.data(), copyLen);
+SMTC_API int SMTC_CtxGetArtist(SMTC_Context* context, char* buffer, int len) {
+    if (!context || !buffer || len <= 0) return 0;
+    ScopedLatency latency(context->stats.getterLatency);
+    std::lock_guard<std::mutex> lk(context->dataMutex);
+    if (context->artist.empty()) return 0;
+    int copyLen = std::min<int>(len - 1, (int)context->artist.size());
+    memcpy(buffer, context->artist.data(), copyLen);
+    buffer[copyLen] = '\0';
     return copyLen;
 }
-extern "C" __declspec(dllexport) void SMTC_SetTimeline(long long positionTicks) {
-    EnqueueControl([positionTicks](auto session) {
-        session.TryChangePlaybackPositionAsync(positionTicks);
+SMTC_API bool SMTC_CtxGetPlaybackStatus(SMTC_Context* context) {
+    if (!context) return false;
+    ScopedLatency latency(context->stats.getterLatency);
+    std::lock_guard<std::mutex> lk(context->dataMutex);
+    return context->isPlaying;
+}
+SMTC_API void SMTC_CtxGetTimeline(SMTC_Context* context, long long* position, long long* duration) {
+    if (!context || !position || !duration) return;
+    ScopedLatency latency(context->stats.getterLatency);
+    std::lock_guard<std::mutex> lk(context->dataMutex);
+    *position = context->positionTicks;
+    *duration = context->durationTicks;
+}
+#if SMTC_FEATURE_COVER
+SMTC_API int SMTC_CtxGetCoverImage(SMTC_Context* context, uint8_t* buffer, int len) {
+    if (!context || !buffer || len <= 0) return 0;
+    ScopedLatency latency(context->stats.getterLatency);
+    std::lock_guard<std::mutex> lk(context->dataMutex);
+    if (context->coverBuffer.empty()) return 0;
+    int copyLen = std::min<int>(len, (int)context->coverBuffer.size());
+    memcpy(buffer, context->coverBuffer.data(), copyLen);
+    return copyLen;
+}
+#endif
+static void CopyField(char* dest, size_t destSize, const std::string& src) {
+    size_t copyLen = std::min(destSize - 1, src.size());
+    memcpy(dest, src.data(), copyLen);
+    dest[copyLen] = '\0';
+}
+
+// һζȡȫչԪݣ sinceVersion 仯ֶ룬ֻЩֶλᱻд info
+// ״εô 0 ɵõȫֶΡ
+SMTC_API uint64_t SMTC_CtxGetMediaInfo(SMTC_Context* context, SMTC_MediaInfo* info, uint64_t sinceVersion) {
+    if (!context || !info) return 0;
+    ScopedLatency latency(context->stats.getterLatency);
+    std::lock_guard<std::mutex> lk(context->dataMutex);
+
+    uint64_t mask = ChangedFieldMask_Locked(context, sinceVersion);
+    auto has = [mask](SMTC_Field f) { return (mask & (1ULL << f)) != 0; };
+
+    if (has(SMTC_Field_Title)) CopyField(info->title, sizeof(info->title), context->title);
+    if (has(SMTC_Field_Artist)) CopyField(info->artist, sizeof(info->artist), context->artist);
+    if (has(SMTC_Field_AlbumTitle)) CopyField(info->albumTitle, sizeof(info->albumTitle), context->albumTitle);
+    if (has(SMTC_Field_AlbumArtist)) CopyField(info->albumArtist, sizeof(info->albumArtist), context->albumArtist);
+    if (has(SMTC_Field_Genres)) CopyField(info->genres, sizeof(info->genres), context->genres);
+    if (has(SMTC_Field_TrackNumber)) info->trackNumber = context->trackNumber;
+    if (has(SMTC_Field_AlbumTrackCount)) info->albumTrackCount = context->albumTrackCount;
+    if (has(SMTC_Field_PlaybackType)) info->playbackType = context->playbackType;
+    if (has(SMTC_Field_PlaybackStatus)) info->playbackStatus = context->playbackStatus;
+    if (has(SMTC_Field_PlaybackRate)) info->playbackRate = context->playbackRate;
+    if (has(SMTC_Field_Shuffle)) info->shuffle = context->shuffle;
+    if (has(SMTC_Field_RepeatMode)) info->repeatMode = context->repeatMode;
+    if (has(SMTC_Field_EnabledControls)) info->enabledControls = context->enabledControls;
+    if (has(SMTC_Field_Position)) info->positionTicks = context->positionTicks;
+    if (has(SMTC_Field_Duration)) info->durationTicks = context->durationTicks;
+#if SMTC_FEATURE_COVER
+    if (has(SMTC_Field_Cover)) {
+        info->coverSize = static_cast<uint32_t>(context->coverBuffer.size());
+        info->coverHash = context->coverHash;
+    }
+#endif
+
+    info->version = context->dataVersion;
+    info->changedMask = mask;
+    return mask;
+}
+
+#if SMTC_FEATURE_CONTROLS
+SMTC_API void SMTC_CtxSetTimeline(SMTC_Context* context, long long positionTicks) {
+    if (!context) return;
+    EnqueueControl(context, [positionTicks](IMediaSession& session) {
+        session.ChangePosition(positionTicks);
         });
-}
\ No newline at end of file
+}
+#endif
+
+// ֵ̹Linux ϶Ӧ VmRSS / VmHWM
+static bool QueryProcessMemory(uint64_t& workingSet, uint64_t& peakWorkingSet) {
+#if SMTC_PLATFORM_WINDOWS
+    PROCESS_MEMORY_COUNTERS pmc{};
+    pmc.cb = sizeof(pmc);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return false;
+    workingSet = pmc.WorkingSetSize;
+    peakWorkingSet = pmc.PeakWorkingSetSize;
+    return true;
+#else
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    uint64_t kb = 0;
+    bool found = false;
+    while (status >> key) {
+        if (key == "VmRSS:" && status >> kb) { workingSet = kb * 1024; found = true; }
+        else if (key == "VmHWM:" && status >> kb) peakWorkingSet = kb * 1024;
+    }
+    return found;
+#endif
+}
+
+// ȡͳƣ̵߳ã
+SMTC_API void SMTC_CtxGetStats(SMTC_Context* context, SMTC_Stats* stats) {
+    if (!context || !stats) return;
+    SMTC_Stats out{};
+    BridgeStats& s = context->stats;
+    out.tasksExecuted = s.tasksExecuted.load(std::memory_order_relaxed);
+    out.timersFired = s.timersFired.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lk(context->queueMutex);
+        out.queueLength = static_cast<uint32_t>(context->taskQueue.size());
+        out.queueHighWater = s.queueHighWater;
+    }
+    s.queueLatency.Snapshot(out.queueLatency);
+    s.taskDuration.Snapshot(out.taskDuration);
+    s.callbackDuration.Snapshot(out.callbackDuration);
+    s.eventLatency.Snapshot(out.eventLatency);
+    s.getterLatency.Snapshot(out.getterLatency);
+#if SMTC_FEATURE_COVER
+    {
+        std::lock_guard<std::mutex> lk(context->dataMutex);
+        out.coverBytes = context->coverBuffer.size();
+    }
+#endif
+    QueryProcessMemory(out.workingSetBytes, out.peakWorkingSetBytes);
+    *stats = out;
+}
+
+// ֱͼͶиˮλӰڴͳƣ
+SMTC_API void SMTC_CtxResetStats(SMTC_Context* context) {
+    if (!context) return;
+    BridgeStats& s = context->stats;
+    s.tasksExecuted.store(0, std::memory_order_relaxed);
+    s.timersFired.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lk(context->queueMutex);
+        s.queueHighWater = static_cast<uint32_t>(context->taskQueue.size());
+    }
+    s.queueLatency.Reset();
+    s.taskDuration.Reset();
+    s.callbackDuration.Reset();
+    s.eventLatency.Reset();
+    s.getterLatency.Reset();
+}
+
+
+// =================  IPC ķ =================
+// ѡķģʽһйŽģؽ̶ģͬһ WinRT ġ
+// Windows ʹܵƽ̨ʹ Unix ׽֣ѹ Linux ϸһ·߶ֻܵǰûӡ
+//
+// ֡ʽСˣu32 ȣֽڣ | u8  | 
+//    -> ͻ
+//     0x01 SnapshotӺĵһ֡ȫֶ
+//     0x02 Delta   ֮ÿݱ仯һֻ֡仯ֶ
+//     ߸ͬu64 version | u64 mask |  SMTC_Field ˳α mask еֶ
+//       ַu16 ֽ + UTF-8int32 / uint32 / int64 / double ԭʼȣ
+//       Coveru64 hash | u32 size | size ֽͼݣڷϣ仯ʱ֣
+//   ͻ -> 
+//     0x10 Command u8 SMTC_IpcCommand + SetVolume: f32FadeVolume: f32, i32 룻SetTimeline: i64
+//
+// ÿͻһ̣߳ͬʱȴдֹͣźţWindows ص I/Oƽ̨ poll״ֻ̬֡һΣ
+//  shared_ptr ַпͻ˵ķͶУĳͻ˻ѹʱУΪһ֡ա
+enum IpcFrameType : uint8_t {
+    IpcFrame_Snapshot = 0x01,
+    IpcFrame_Delta = 0x02,
+    IpcFrame_Command = 0x10
+};
+
+enum SMTC_IpcCommand : uint8_t {
+    SMTC_IpcCommand_PlayPause = 0,
+    SMTC_IpcCommand_Play = 1,
+    SMTC_IpcCommand_Pause = 2,
+    SMTC_IpcCommand_Next = 3,
+    SMTC_IpcCommand_Previous = 4,
+    SMTC_IpcCommand_VolumeUp = 5,
+    SMTC_IpcCommand_VolumeDown = 6,
+    SMTC_IpcCommand_SetVolume = 7,
+    SMTC_IpcCommand_FadeVolume = 8,
+    SMTC_IpcCommand_SetTimeline = 9
+};
+
+static const size_t kIpcMaxQueuedFrames = 256;
+static const size_t kIpcMaxQueuedBytes = 16 * 1024 * 1024;
+static const uint32_t kIpcMaxInboundFrame = 64; // ͻֻ֡˳ΪЭ󲢶Ͽ
+
+using IpcFrame = std::shared_ptr<const std::vector<uint8_t>>;
+
+#if SMTC_PLATFORM_WINDOWS
+using IpcHandle = HANDLE;
+static const IpcHandle kInvalidIpcHandle = INVALID_HANDLE_VALUE;
+static void CloseIpcHandle(IpcHandle handle) { CloseHandle(handle); }
+#else
+using IpcHandle = int;
+static const IpcHandle kInvalidIpcHandle = -1;
+static void CloseIpcHandle(IpcHandle handle) { close(handle); }
+#endif
+
+// źţWindows ¼ƽ̨һԹܵ˿Ժ׽һ pollѺɵȴ Drain
+struct IpcSignal {
+    IpcSignal() = default;
+    IpcSignal(const IpcSignal&) = delete;
+    IpcSignal& operator=(const IpcSignal&) = delete;
+#if SMTC_PLATFORM_WINDOWS
+    HANDLE event = nullptr;
+
+    bool Open(bool manualReset) { event = CreateEventW(nullptr, manualReset, FALSE, nullptr); return event != nullptr; }
+    void Set() { SetEvent(event); }
+    ~IpcSignal() { if (event) CloseHandle(event); }
+#else
+    int fds[2] = { -1, -1 }; // [0] ˣ[1] д
+
+    bool Open(bool) { return pipe2(fds, O_CLOEXEC | O_NONBLOCK) == 0; }
+    void Set() { char c = 0; (void)!write(fds[1], &c, 1); } // ܵʱдʧҲ޷Ȼɶ
+    void Drain() { char buf[64]; while (read(fds[0], buf, sizeof(buf)) > 0) {} }
+    ~IpcSignal() { for (int fd : fds) if (fd >= 0) close(fd); }
+#endif
+};
+
+struct IpcClient {
+    IpcHandle pipe = kInvalidIpcHandle; // ܵʵӵ׽
+    IpcSignal wake;             // ԶãͶ֡
+    std::thread thread;
+    std::mutex mutex;           //  outbox / outboxBytes
+    std::deque<IpcFrame> outbox;
+    size_t outboxBytes = 0;
+    std::atomic<bool> needsSnapshot{ false };
+    std::atomic<bool> closed{ false };
+};
+
+struct IpcServer {
+    SMTC_Context* ctx = nullptr;
+    IpcSignal stop;             // ֶ
+#if SMTC_PLATFORM_WINDOWS
+    std::wstring pipeName;
+    PSECURITY_DESCRIPTOR security = nullptr; // ֻǰûʣÿܵʵʹ
+    ~IpcServer() { if (security) LocalFree(security); }
+#else
+    std::string socketPath;
+#endif
+    std::thread acceptThread;
+    std::mutex mutex;           //  clients / publishedVersion˳IpcServer::mutex -> IpcClient::mutex -> dataMutex
+    std::vector<std::shared_ptr<IpcClient>> clients;
+    uint64_t publishedVersion = 0;
+    // ǰ汾Ŀգ벹Ŀͻ˹ãֽڼ ipcQueuedBytesһηʱͷ
+    IpcFrame snapshot;
+    uint64_t snapshotVersion = 0;
+    uint64_t snapshotMask = 0;
+    uint64_t snapshotEncodes = 0; // ձѹԼ鹲ǷЧ
+};
+
+template <typename T>
+static void PutPod(std::vector<uint8_t>& out, T value) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+static void PutString(std::vector<uint8_t>& out, const std::string& value) {
+    uint16_t len = static_cast<uint16_t>(std::min<size_t>(value.size(), 0xFFFF));
+    PutPod(out, len);
+    out.insert(out.end(), value.begin(), value.begin() + len);
+}
+
+// һ֡״̬Delta ûб仯ʱؿաSnapshot ֻ fieldMask еֶΡ÷ dataMutex
+static IpcFrame EncodeStateFrame_Locked(SMTC_Context* ctx, IpcFrameType type, uint64_t sinceVersion, uint64_t* versionOut, uint64_t fieldMask = kAvailableFieldMask) {
+    std::vector<uint8_t> frame(5); // ǰ׺
+    frame[4] = type;
+    {
+        uint64_t mask = (type == IpcFrame_Snapshot) ? fieldMask : ChangedFieldMask_Locked(ctx, sinceVersion);
+        if (mask == 0) return nullptr;
+        PutPod(frame, ctx->dataVersion);
+        PutPod(frame, mask);
+        for (int i = 0; i < SMTC_FieldCount; i++) {
+            if (!(mask & (1ULL << i))) continue;
+            switch (static_cast<SMTC_Field>(i)) {
+            case SMTC_Field_Title: PutString(frame, ctx->title); break;
+            case SMTC_Field_Artist: PutString(frame, ctx->artist); break;
+            case SMTC_Field_AlbumTitle: PutString(frame, ctx->albumTitle); break;
+            case SMTC_Field_AlbumArtist: PutString(frame, ctx->albumArtist); break;
+            case SMTC_Field_TrackNumber: PutPod(frame, ctx->trackNumber); break;
+            case SMTC_Field_AlbumTrackCount: PutPod(frame, ctx->albumTrackCount); break;
+            case SMTC_Field_Genres: PutString(frame, ctx->genres); break;
+            case SMTC_Field_PlaybackType: PutPod(frame, ctx->playbackType); break;
+            case SMTC_Field_PlaybackStatus: PutPod(frame, ctx->playbackStatus); break;
+            case SMTC_Field_PlaybackRate: PutPod(frame, ctx->playbackRate); break;
+            case SMTC_Field_Shuffle: PutPod(frame, ctx->shuffle); break;
+            case SMTC_Field_RepeatMode: PutPod(frame, ctx->repeatMode); break;
+            case SMTC_Field_EnabledControls: PutPod(frame, ctx->enabledControls); break;
+            case SMTC_Field_Position: PutPod(frame, ctx->positionTicks); break;
+            case SMTC_Field_Duration: PutPod(frame, ctx->durationTicks); break;
+#if SMTC_FEATURE_COVER
+            case SMTC_Field_Cover:
+                PutPod(frame, ctx->coverHash);
+                PutPod(frame, static_cast<uint32_t>(ctx->coverBuffer.size()));
+                frame.insert(frame.end(), ctx->coverBuffer.begin(), ctx->coverBuffer.end());
+                break;
+#endif
+            default: break;
+            }
+        }
+        if (versionOut) *versionOut = ctx->dataVersion;
+    }
+    uint32_t len = static_cast<uint32_t>(frame.size() - 4);
+    memcpy(frame.data(), &len, sizeof(len));
+    return std::make_shared<const std::vector<uint8_t>>(std::move(frame));
+}
+
+static IpcFrame EncodeStateFrame(SMTC_Context* ctx, IpcFrameType type, uint64_t sinceVersion, uint64_t* versionOut) {
+    std::lock_guard<std::mutex> lk(ctx->dataMutex);
+    return EncodeStateFrame_Locked(ctx, type, sinceVersion, versionOut);
+}
+
+// ÷ server->mutex
+// ÿͻ˷ͶеֽޣڴԤʱԤ۳ַͷ clientCount ͻƽ
+static size_t IpcQueueLimit_Locked(SMTC_Context* ctx, size_t clientCount) {
+    uint64_t budget = ctx->memoryBudget.load();
+    if (!budget) return kIpcMaxQueuedBytes;
+    uint64_t held = 0;
+    {
+        std::lock_guard<std::mutex> lk(ctx->dataMutex);
+        held = StringBytes_Locked(ctx);
+#if SMTC_FEATURE_COVER
+        held += ctx->coverBuffer.capacity();
+#endif
+    }
+    uint64_t share = (budget > held ? budget - held : 0) / std::max<size_t>(clientCount, 1);
+    return static_cast<size_t>(std::min<uint64_t>(share, kIpcMaxQueuedBytes));
+}
+
+// ÷ server->mutex
+static void ReleaseSharedSnapshot_Locked(IpcServer* server) {
+    if (!server->snapshot) return;
+    server->ctx->ipcQueuedBytes -= server->snapshot->size();
+    server->snapshot.reset();
+}
+
+// ÷ server->mutex  dataMutex
+// ȡǰ汾Ŀգͬһ汾ֻһΣҪյĿͻ˹á
+// Ŀճÿͻ˵Ķ byteLimit ʱΪ棬ͻڷһα仯ʱյ
+static IpcFrame SharedSnapshot_Locked(IpcServer* server, size_t byteLimit) {
+    SMTC_Context* ctx = server->ctx;
+    if (!server->snapshot || server->snapshotVersion != ctx->dataVersion) {
+        ReleaseSharedSnapshot_Locked(server);
+        server->snapshot = EncodeStateFrame_Locked(ctx, IpcFrame_Snapshot, 0, nullptr);
+        server->snapshotVersion = ctx->dataVersion;
+        server->snapshotMask = kAvailableFieldMask;
+        server->snapshotEncodes++;
+        ctx->ipcQueuedBytes += server->snapshot->size();
+    }
+#if SMTC_FEATURE_COVER
+    const uint64_t coverBit = 1ULL << SMTC_Field_Cover;
+    if (server->snapshot->size() > byteLimit && (server->snapshotMask & coverBit)) {
+        ReleaseSharedSnapshot_Locked(server);
+        server->snapshotMask = kAvailableFieldMask & ~coverBit;
+        server->snapshot = EncodeStateFrame_Locked(ctx, IpcFrame_Snapshot, 0, nullptr, server->snapshotMask);
+        server->snapshotEncodes++;
+        ctx->ipcQueuedBytes += server->snapshot->size();
+    }
+#endif
+    return server->snapshot;
+}
+
+static void QueueIpcFrame_Locked(SMTC_Context* ctx, IpcClient* client, const IpcFrame& frame, size_t byteLimit) {
+    {
+        std::lock_guard<std::mutex> lk(client->mutex);
+        if (client->outbox.size() >= kIpcMaxQueuedFrames || client->outboxBytes + frame->size() > byteLimit) {
+            // ͻ˶̫ѹԺɿͻ̲߳һ֡¿
+            ctx->ipcQueuedBytes -= client->outboxBytes;
+            client->outbox.clear();
+            client->outboxBytes = 0;
+            client->needsSnapshot.store(true);
+        }
+        else {
+            client->outbox.push_back(frame);
+            client->outboxBytes += frame->size();
+            ctx->ipcQueuedBytes += frame->size();
+        }
+    }
+    client->wake.Set();
+}
+
+static void PublishIpcDelta(SMTC_Context* ctx) {
+    std::shared_ptr<IpcServer> server;
+    { std::lock_guard<std::mutex> lk(ctx->serverMutex); server = ctx->server; }
+    if (!server) return;
+
+    std::lock_guard<std::mutex> lk(server->mutex);
+    ReleaseSharedSnapshot_Locked(server.get()); // ѱ仯ɿղٱʹ
+    if (server->clients.empty()) return;
+    uint64_t version = 0;
+    IpcFrame frame = EncodeStateFrame(ctx, IpcFrame_Delta, server->publishedVersion, &version);
+    if (!frame) return;
+    server->publishedVersion = version;
+    size_t byteLimit = IpcQueueLimit_Locked(ctx, server->clients.size());
+    for (auto& client : server->clients) {
+        QueueIpcFrame_Locked(ctx, client.get(), frame, byteLimit);
+    }
+}
+
+// ִпͻ˷֡Э󷵻 false
+static bool HandleIpcCommands(SMTC_Context* ctx, std::vector<uint8_t>& inbox) {
+    size_t offset = 0;
+    while (inbox.size() - offset >= 4) {
+        uint32_t len = 0;
+        memcpy(&len, inbox.data() + offset, sizeof(len));
+        if (len == 0 || len > kIpcMaxInboundFrame) return false;
+        if (inbox.size() - offset - 4 < len) break;
+
+        const uint8_t* body = inbox.data() + offset + 4;
+        if (body[0] != IpcFrame_Command || len < 2) return false;
+        [[maybe_unused]] const uint8_t* args = body + 2;
+        [[maybe_unused]] size_t argLen = len - 2;
+        // üܵδ֪һ
+        switch (body[1]) {
+#if SMTC_FEATURE_CONTROLS
+        case SMTC_IpcCommand_PlayPause: SMTC_CtxPlayPause(ctx); break;
+        case SMTC_IpcCommand_Play: SMTC_CtxPlay(ctx); break;
+        case SMTC_IpcCommand_Pause: SMTC_CtxPause(ctx); break;
+        case SMTC_IpcCommand_Next: SMTC_CtxNext(ctx); break;
+        case SMTC_IpcCommand_Previous: SMTC_CtxPrevious(ctx); break;
+        case SMTC_IpcCommand_SetTimeline: {
+            if (argLen < sizeof(int64_t)) return false;
+            int64_t positionTicks; memcpy(&positionTicks, args, sizeof(positionTicks));
+            SMTC_CtxSetTimeline(ctx, positionTicks);
+            break;
+        }
+#endif
+#if SMTC_FEATURE_SESSION_VOLUME
+        case SMTC_IpcCommand_VolumeUp: SMTC_CtxVolumeUp(ctx); break;
+        case SMTC_IpcCommand_VolumeDown: SMTC_CtxVolumeDown(ctx); break;
+        case SMTC_IpcCommand_SetVolume: {
+            if (argLen < sizeof(float)) return false;
+            float volume; memcpy(&volume, args, sizeof(volume));
+            SMTC_CtxSetVolume(ctx, volume);
+            break;
+        }
+        case SMTC_IpcCommand_FadeVolume: {
+            if (argLen < sizeof(float) + sizeof(int32_t)) return false;
+            float volume; int32_t durationMs;
+            memcpy(&volume, args, sizeof(volume));
+            memcpy(&durationMs, args + sizeof(volume), sizeof(durationMs));
+            SMTC_CtxFadeVolume(ctx, volume, durationMs);
+            break;
+        }
+#endif
+        default: break; // δ֪ԣЭչ
+        }
+        offset += 4 + len;
+    }
+    inbox.erase(inbox.begin(), inbox.begin() + offset);
+    return true;
+}
+
+// ȡһ֡͵ݣҪʱ¿滻ѹΪʱؿ
+static IpcFrame NextIpcFrame(IpcServer* server, IpcClient* client) {
+    if (client->needsSnapshot.exchange(false)) {
+        std::lock_guard<std::mutex> serverLock(server->mutex);
+        size_t byteLimit = IpcQueueLimit_Locked(server->ctx, server->clients.size());
+        IpcFrame snapshot;
+        {
+            std::lock_guard<std::mutex> dataLock(server->ctx->dataMutex);
+            snapshot = SharedSnapshot_Locked(server, byteLimit);
+        }
+        std::lock_guard<std::mutex> lk(client->mutex);
+        // Ѱ޲õ棻ԳʱҲÿͻܱһ֡
+        server->ctx->ipcQueuedBytes += snapshot->size();
+        server->ctx->ipcQueuedBytes -= client->outboxBytes;
+        client->outbox.clear();
+        client->outbox.push_back(snapshot);
+        client->outboxBytes = snapshot->size();
+    }
+
+    std::lock_guard<std::mutex> lk(client->mutex);
+    if (client->outbox.empty()) return nullptr;
+    IpcFrame frame = std::move(client->outbox.front());
+    client->outbox.pop_front();
+    client->outboxBytes -= frame->size();
+    server->ctx->ipcQueuedBytes -= frame->size();
+    return frame;
+}
+
+static void IpcClientThread(IpcServer* server, std::shared_ptr<IpcClient> client);
+
+static void CloseIpcClient(IpcServer* server, const std::shared_ptr<IpcClient>& client) {
+    if (client->thread.joinable()) client->thread.join();
+    server->ctx->ipcQueuedBytes -= client->outboxBytes; // ߳˳޸ outbox
+    if (client->pipe != kInvalidIpcHandle) CloseIpcHandle(client->pipe);
+}
+
+static void ReapIpcClients(IpcServer* server) {
+    std::vector<std::shared_ptr<IpcClient>> closed;
+    {
+        std::lock_guard<std::mutex> lk(server->mutex);
+        auto it = std::partition(server->clients.begin(), server->clients.end(), [](const std::shared_ptr<IpcClient>& c) { return !c->closed.load(); });
+        closed.assign(std::make_move_iterator(it), std::make_move_iterator(server->clients.end()));
+        server->clients.erase(it, server->clients.end());
+    }
+    for (auto& client : closed) CloseIpcClient(server, client);
+}
+
+static void AddIpcClient(IpcServer* server, IpcHandle pipe) {
+    auto client = std::make_shared<IpcClient>();
+    client->pipe = pipe;
+    if (!client->wake.Open(false)) { CloseIpcHandle(pipe); return; }
+
+    std::lock_guard<std::mutex> lk(server->mutex);
+    // бͬһɣ֮ Delta һڿ֮
+    // Ȱδı仯Ϊ Delta пͻˣԿհ汾Ϊ㣬
+    // ¿ͻյĵһ֡ Delta ظеֶΣǷ棩
+    size_t byteLimit = IpcQueueLimit_Locked(server->ctx, server->clients.size() + 1);
+    IpcFrame pending, snapshot;
+    {
+        std::lock_guard<std::mutex> dataLock(server->ctx->dataMutex);
+        if (!server->clients.empty()) pending = EncodeStateFrame_Locked(server->ctx, IpcFrame_Delta, server->publishedVersion, nullptr);
+        snapshot = SharedSnapshot_Locked(server, byteLimit);
+        server->publishedVersion = server->ctx->dataVersion;
+    }
+    if (pending) {
+        for (auto& existing : server->clients) QueueIpcFrame_Locked(server->ctx, existing.get(), pending, byteLimit);
+    }
+    QueueIpcFrame_Locked(server->ctx, client.get(), snapshot, byteLimit);
+    server->clients.push_back(client);
+    client->thread = std::thread([server, client]() { IpcClientThread(server, client); });
+}
+
+#if SMTC_PLATFORM_WINDOWS
+// ѷͶдꣻдʧֹܻͣʱ false
+static bool FlushIpcOutbox(IpcServer* server, IpcClient* client, HANDLE writeEvent) {
+    while (IpcFrame frame = NextIpcFrame(server, client)) {
+        OVERLAPPED ov{};
+        ov.hEvent = writeEvent;
+        DWORD size = static_cast<DWORD>(frame->size());
+        if (!WriteFile(client->pipe, frame->data(), size, nullptr, &ov) && GetLastError() != ERROR_IO_PENDING) return false;
+
+        HANDLE waits[2] = { server->stop.event, writeEvent };
+        DWORD written = 0;
+        if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+            CancelIoEx(client->pipe, &ov);
+            GetOverlappedResult(client->pipe, &ov, &written, TRUE);
+            return false;
+        }
+        if (!GetOverlappedResult(client->pipe, &ov, &written, FALSE) || written != size) return false;
+    }
+    return true;
+}
+
+static void IpcClientThread(IpcServer* server, std::shared_ptr<IpcClient> client) {
+    HANDLE readEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    HANDLE writeEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    uint8_t readBuf[256];
+    std::vector<uint8_t> inbox;
+    OVERLAPPED readOv{};
+    bool readPending = false;
+
+    auto issueRead = [&]() -> bool {
+        readOv = {};
+        readOv.hEvent = readEvent;
+        if (!ReadFile(client->pipe, readBuf, sizeof(readBuf), nullptr, &readOv) && GetLastError() != ERROR_IO_PENDING) return false;
+        readPending = true;
+        return true;
+    };
+
+    bool ok = readEvent && writeEvent && issueRead();
+    while (ok) {
+        HANDLE waits[3] = { server->stop.event, readEvent, client->wake.event };
+        DWORD r = WaitForMultipleObjects(3, waits, FALSE, INFINITE);
+        if (r == WAIT_OBJECT_0 + 1) {
+            DWORD n = 0;
+            readPending = false;
+            if (!GetOverlappedResult(client->pipe, &readOv, &n, FALSE)) break; // ͻ˶Ͽ
+            inbox.insert(inbox.end(), readBuf, readBuf + n);
+            ok = HandleIpcCommands(server->ctx, inbox) && issueRead();
+        }
+        else if (r == WAIT_OBJECT_0 + 2) {
+            ok = FlushIpcOutbox(server, client.get(), writeEvent);
+        }
+        else {
+            break; // ֹͣȴʧ
+        }
+    }
+
+    if (readPending) {
+        DWORD n = 0;
+        CancelIoEx(client->pipe, &readOv);
+        GetOverlappedResult(client->pipe, &readOv, &n, TRUE); // ȴȡɣreadBuf ֮ͷ
+    }
+    DisconnectNamedPipe(client->pipe);
+    if (readEvent) CloseHandle(readEvent);
+    if (writeEvent) CloseHandle(writeEvent);
+    client->closed.store(true);
+}
+
+// ֻǰûʵİȫSDDLD:P(A;;GA;;;<ǰû SID>)ʧܷ nullptr LocalFree ͷ
+static PSECURITY_DESCRIPTOR CreateCurrentUserSecurity() {
+    HANDLE token = nullptr;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) return nullptr;
+    PSECURITY_DESCRIPTOR security = nullptr;
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+    std::vector<uint8_t> user(size);
+    LPWSTR sid = nullptr;
+    if (size && GetTokenInformation(token, TokenUser, user.data(), size, &size) &&
+        ConvertSidToStringSidW(reinterpret_cast<TOKEN_USER*>(user.data())->User.Sid, &sid)) {
+        std::wstring sddl = L"D:P(A;;GA;;;" + std::wstring(sid) + L")";
+        if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl.c_str(), SDDL_REVISION_1, &security, nullptr)) security = nullptr;
+        LocalFree(sid);
+    }
+    CloseHandle(token);
+    return security;
+}
+
+static HANDLE CreateIpcPipe(IpcServer* server, bool firstInstance) {
+    SECURITY_ATTRIBUTES sa{ sizeof(sa), server->security, FALSE };
+    DWORD openMode = PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (firstInstance ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0);
+    return CreateNamedPipeW(server->pipeName.c_str(), openMode, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                            PIPE_UNLIMITED_INSTANCES, 64 * 1024, 4 * 1024, 0, &sa);
+}
+
+// name Ϊʱʹ \\.\pipe\SMTCBridge޷찲ȫʱû
+static HANDLE OpenIpcListener(IpcServer* server, const wchar_t* name) {
+    server->pipeName = (name && *name) ? name : L"\\\\.\\pipe\\SMTCBridge";
+    server->security = CreateCurrentUserSecurity();
+    if (!server->security) return INVALID_HANDLE_VALUE;
+    return CreateIpcPipe(server, true);
+}
+
+static void IpcAcceptThread(IpcServer* server, HANDLE pipe) {
+    HANDLE connectEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    while (connectEvent && pipe != INVALID_HANDLE_VALUE) {
+        OVERLAPPED ov{};
+        ov.hEvent = connectEvent;
+        bool connected = ConnectNamedPipe(pipe, &ov) != FALSE;
+        bool stopping = false;
+        if (!connected) {
+            DWORD err = GetLastError();
+            if (err == ERROR_PIPE_CONNECTED) {
+                connected = true;
+            }
+            else if (err == ERROR_IO_PENDING) {
+                HANDLE waits[2] = { server->stop.event, connectEvent };
+                DWORD n = 0;
+                if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+                    connected = GetOverlappedResult(pipe, &ov, &n, FALSE) != FALSE;
+                }
+                else {
+                    CancelIoEx(pipe, &ov);
+                    GetOverlappedResult(pipe, &ov, &n, TRUE);
+                    stopping = true;
+                }
+            }
+        }
+
+        if (stopping) {
+            CloseHandle(pipe);
+            pipe = INVALID_HANDLE_VALUE;
+            break;
+        }
+        // ȴһʵƽӵĹ֤ܵκʱ̶ʵɹӣ
+        // ͻ˻μ϶еõ ERROR_FILE_NOT_FOUND
+        HANDLE next = CreateIpcPipe(server, false);
+        if (connected) {
+            AddIpcClient(server, pipe);
+        }
+        else {
+            CloseHandle(pipe);
+        }
+        pipe = next;
+        ReapIpcClients(server);
+
+        // ӻ򴴽ʵʧʱȴ쳣״̬¿ת
+        if (WaitForSingleObject(server->stop.event, (connected && pipe != INVALID_HANDLE_VALUE) ? 0 : 100) == WAIT_OBJECT_0) break;
+        if (pipe == INVALID_HANDLE_VALUE) pipe = CreateIpcPipe(server, false);
+    }
+    if (pipe != INVALID_HANDLE_VALUE) CloseHandle(pipe);
+    if (connectEvent) CloseHandle(connectEvent);
+}
+
+#else
+static std::string WideToUtf8(const std::wstring& text) {
+    std::string out;
+    for (wchar_t wc : text) {
+        uint32_t c = static_cast<uint32_t>(wc);
+        if (c < 0x80) {
+            out += static_cast<char>(c);
+        }
+        else if (c < 0x800) {
+            out += static_cast<char>(0xC0 | (c >> 6));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000) {
+            out += static_cast<char>(0xE0 | (c >> 12));
+            out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else {
+            out += static_cast<char>(0xF0 | (c >> 18));
+            out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+// Ĭ׽ַֻڵǰû $XDG_RUNTIME_DIR Уûʱ˻ /tmp/SMTCBridge-<uid>.sock
+static std::string DefaultIpcSocketPath() {
+    const char* runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir && *runtimeDir) return std::string(runtimeDir) + "/SMTCBridge.sock";
+    return "/tmp/SMTCBridge-" + std::to_string(geteuid()) + ".sock";
+}
+
+static bool IpcPeerIsCurrentUser(int fd) {
+#ifdef SO_PEERCRED
+    ucred peer{};
+    socklen_t len = sizeof(peer);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &len) == 0 && peer.uid == geteuid();
+#else
+    uid_t uid = 0;
+    gid_t gid = 0;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == geteuid();
+#endif
+}
+
+// ѷͶдꣻдʧֹܻͣʱ false׽Ƿģдʱֹͣźһ poll
+static bool FlushIpcOutbox(IpcServer* server, IpcClient* client) {
+    while (IpcFrame frame = NextIpcFrame(server, client)) {
+        size_t offset = 0;
+        while (offset < frame->size()) {
+            ssize_t n = send(client->pipe, frame->data() + offset, frame->size() - offset, MSG_NOSIGNAL);
+            if (n > 0) {
+                offset += static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            pollfd fds[2] = { { server->stop.fds[0], POLLIN, 0 }, { client->pipe, POLLOUT, 0 } };
+            if (poll(fds, 2, -1) < 0 && errno != EINTR) return false;
+            if (fds[0].revents) return false;
+        }
+    }
+    return true;
+}
+
+static void IpcClientThread(IpcServer* server, std::shared_ptr<IpcClient> client) {
+    uint8_t readBuf[256];
+    std::vector<uint8_t> inbox;
+    bool ok = true;
+    while (ok) {
+        pollfd fds[3] = { { server->stop.fds[0], POLLIN, 0 }, { client->pipe, POLLIN, 0 }, { client->wake.fds[0], POLLIN, 0 } };
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[0].revents) break; // ֹͣ
+        if (fds[1].revents) {
+            ssize_t n = recv(client->pipe, readBuf, sizeof(readBuf), 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) break; // ͻ˶Ͽ
+            if (n > 0) {
+                inbox.insert(inbox.end(), readBuf, readBuf + n);
+                ok = HandleIpcCommands(server->ctx, inbox);
+            }
+        }
+        if (ok && fds[2].revents) {
+            client->wake.Drain();
+            ok = FlushIpcOutbox(server, client.get());
+        }
+    }
+    shutdown(client->pipe, SHUT_RDWR);
+    client->closed.store(true);
+}
+
+static bool IpcSocketInUse(const sockaddr_un& addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    bool inUse = connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    close(fd);
+    return inUse;
+}
+
+// name ΪʱʹĬ·ܵ FILE_FLAG_FIRST_PIPE_INSTANCE һзڼʱʧܣ
+// ϴ쳣˳µ׽ļᱻ滻׽ļȨΪ 0600ʱٺ˶ԶԶ uid
+static int OpenIpcListener(IpcServer* server, const wchar_t* name) {
+    server->socketPath = (name && *name) ? WideToUtf8(name) : DefaultIpcSocketPath();
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (server->socketPath.empty() || server->socketPath.size() >= sizeof(addr.sun_path)) return -1;
+    memcpy(addr.sun_path, server->socketPath.c_str(), server->socketPath.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    bool bound = bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    if (!bound && errno == EADDRINUSE && !IpcSocketInUse(addr)) {
+        unlink(server->socketPath.c_str());
+        bound = bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    }
+    if (!bound || chmod(server->socketPath.c_str(), S_IRUSR | S_IWUSR) != 0 || listen(fd, SOMAXCONN) != 0) {
+        if (bound) unlink(server->socketPath.c_str());
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void IpcAcceptThread(IpcServer* server, int listener) {
+    for (;;) {
+        pollfd fds[2] = { { server->stop.fds[0], POLLIN, 0 }, { listener, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+        if (fds[0].revents) break;
+        if (!fds[1].revents) continue;
+
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd >= 0) {
+            if (IpcPeerIsCurrentUser(fd)) AddIpcClient(server, fd);
+            else close(fd);
+        }
+        else if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+            // ľ쳣״̬ȴת
+            pollfd stop = { server->stop.fds[0], POLLIN, 0 };
+            if (poll(&stop, 1, 100) > 0) break;
+        }
+        ReapIpcClients(server);
+    }
+    unlink(server->socketPath.c_str());
+    close(listener);
+}
+
+#endif
+
+static void StopIpcServer(SMTC_Context* ctx) {
+    std::shared_ptr<IpcServer> server;
+    { std::lock_guard<std::mutex> lk(ctx->serverMutex); server = std::move(ctx->server); }
+    if (!server) return;
+
+    server->stop.Set();
+    if (server->acceptThread.joinable()) server->acceptThread.join();
+    std::vector<std::shared_ptr<IpcClient>> clients;
+    {
+        std::lock_guard<std::mutex> lk(server->mutex);
+        clients.swap(server->clients);
+        ReleaseSharedSnapshot_Locked(server.get());
+    }
+    for (auto& client : clients) CloseIpcClient(server.get(), client);
+}
+
+//  pipeName ķͬܵѱռʱ false
+// pipeName ΪʱWindows ʹ \\.\pipe\SMTCBridgeƽ̨׽· $XDG_RUNTIME_DIR/SMTCBridge.sock
+SMTC_API bool SMTC_CtxStartServer(SMTC_Context* context, const wchar_t* pipeName) {
+    if (!context) return false;
+    std::lock_guard<std::mutex> lk(context->serverMutex);
+    if (context->server) return true;
+
+    auto server = std::make_shared<IpcServer>();
+    server->ctx = context;
+    if (!server->stop.Open(true)) return false;
+    IpcHandle listener = OpenIpcListener(server.get(), pipeName);
+    if (listener == kInvalidIpcHandle) return false;
+    server->acceptThread = std::thread([raw = server.get(), listener]() { IpcAcceptThread(raw, listener); });
+    context->server = std::move(server);
+    return true;
+}
+
+SMTC_API void SMTC_CtxStopServer(SMTC_Context* context) {
+    if (!context) return;
+    StopIpcServer(context);
+}
+
+// ================= ڴԤ =================
+// ϷڴʱŽӱַ IPC ͶйͬһԤ㣺
+// ַͬŶӵ֡ԤʱȡIPC ֻʹԤ۳ַͷ
+// ɸͻƽ֣ʱѹΪһ֡աڼ䲻ȡҲ档
+struct SMTC_MemoryUsage {
+    uint64_t stringBytes;    // ֶַ
+    uint64_t coverBytes;     // ķ棨ƣ
+    uint64_t ipcQueuedBytes; // IPC Ͷδд֡ÿͻ˵ĶзֱƣԤļ㷽ʽһ£Ϸ˱ĵǰ
+    uint64_t totalBytes;     // ֮
+    uint64_t budgetBytes;    // ǰڴԤ㣬0 ʾ
+    uint32_t coverLimitBytes;// ǰСޣ0 ʾ
+    uint32_t coversSkipped;  // ޻δķ
+    int32_t suspended;       // 1 ʾڹ״̬
+};
+
+#if SMTC_FEATURE_COVER
+// Ԥ//״̬ Worker ִУķ棬ָʱ»ȡ
+static void ApplyMemoryPolicy(SMTC_Context* ctx) {
+    bool dropped = false;
+    bool refetch = false;
+    {
+        std::lock_guard<std::mutex> lk(ctx->dataMutex);
+        if (!ctx->coverBuffer.empty() && !CoverAllowed_Locked(ctx, ctx->coverBuffer.size())) {
+            dropped = DropCover_Locked(ctx);
+        }
+        refetch = ctx->coverBuffer.empty() && !ctx->suspended.load();
+    }
+    if (dropped) {
+        ctx->isDataDirty.store(true);
+        TriggerCallback(ctx, SMTC_EventType::MediaPropertiesChanged);
+    }
+    if (refetch && ctx->currentSession) {
+        SpawnBackendOp(ctx, OpLane::MediaProperties, UpdateMediaProperties(ctx, ctx->currentSession, TimerClock::time_point{}), true);
+    }
+}
+#endif
+
+// ڴԤ㣨ֽڣ0 ʾ
+SMTC_API void SMTC_CtxSetMemoryBudget(SMTC_Context* context, unsigned long long budgetBytes) {
+    if (!context) return;
+    context->memoryBudget.store(budgetBytes);
+#if SMTC_FEATURE_COVER
+    EnqueueTask(context, [context]() { ApplyMemoryPolicy(context); });
+#endif
+}
+
+#if SMTC_FEATURE_COVER
+// õŷĴСޣֽڣ򲻻ȡ0 ʾ
+SMTC_API void SMTC_CtxSetCoverLimit(SMTC_Context* context, unsigned int maxCoverBytes) {
+    if (!context) return;
+    context->coverSizeLimit.store(maxCoverBytes);
+    EnqueueTask(context, [context]() { ApplyMemoryPolicy(context); });
+}
+
+// ͷŷ沢ֹͣȡӲʱָ»ȡǰ
+SMTC_API void SMTC_CtxSetSuspended(SMTC_Context* context, bool suspended) {
+    if (!context) return;
+    if (context->suspended.exchange(suspended) == suspended) return;
+    EnqueueTask(context, [context]() { ApplyMemoryPolicy(context); });
+}
+#endif
+
+// 浱ǰ̵ֽ߳ã
+SMTC_API void SMTC_CtxGetMemoryUsage(SMTC_Context* context, SMTC_MemoryUsage* usage) {
+    if (!context || !usage) return;
+    SMTC_MemoryUsage out{};
+    {
+        std::lock_guard<std::mutex> lk(context->dataMutex);
+        out.stringBytes = StringBytes_Locked(context);
+#if SMTC_FEATURE_COVER
+        out.coverBytes = context->coverBuffer.capacity();
+#endif
+    }
+    out.ipcQueuedBytes = context->ipcQueuedBytes.load();
+    out.totalBytes = out.stringBytes + out.coverBytes + out.ipcQueuedBytes;
+    out.budgetBytes = context->memoryBudget.load();
+#if SMTC_FEATURE_COVER
+    out.coverLimitBytes = context->coverSizeLimit.load();
+    out.coversSkipped = context->coversSkipped.load();
+    out.suspended = context->suspended.load() ? 1 : 0;
+#endif
+    *usage = out;
+}
+
+// ================= ӿڣĬģ =================
+
+// **ע C# ص**
+SMTC_API void RegisterUpdateCallback(SMTC_UpdateCallback callback) {
+    SMTC_Context* ctx = DefaultContext();
+    std::lock_guard<std::mutex> lk(ctx->callbackMutex);
+    ctx->externalCallback = callback;
+}
+
+// **ݱ仯־**
+SMTC_API void SMTC_ClearDataDirtyFlag() { SMTC_CtxClearDataDirtyFlag(DefaultContext()); }
+
+// **Ƿݱ仯**
+SMTC_API bool SMTC_IsDataDirty() { return SMTC_CtxIsDataDirty(DefaultContext()); }
+
+
+SMTC_API void InitSMTC() { StartContext(DefaultContext()); }
+
+SMTC_API void ShutdownSMTC() { StopContext(DefaultContext()); }
+
+
+// رĹܣSMTC_Feature λ÷ݴжЩӿڿ
+SMTC_API uint32_t SMTC_GetFeatures() { return kCompiledFeatures; }
+
+
+#if SMTC_FEATURE_CONTROLS
+SMTC_API void SMTC_PlayPause() { SMTC_CtxPlayPause(DefaultContext()); }
+SMTC_API void SMTC_Play() { SMTC_CtxPlay(DefaultContext()); }
+SMTC_API void SMTC_Pause() { SMTC_CtxPause(DefaultContext()); }
+SMTC_API void SMTC_Next() { SMTC_CtxNext(DefaultContext()); }
+SMTC_API void SMTC_Previous() { SMTC_CtxPrevious(DefaultContext()); }
+SMTC_API void SMTC_SetTimeline(long long positionTicks) { SMTC_CtxSetTimeline(DefaultContext(), positionTicks); }
+#endif
+
+#if SMTC_FEATURE_SESSION_VOLUME
+SMTC_API void SMTC_VolumeUp() { SMTC_CtxVolumeUp(DefaultContext()); }
+SMTC_API void SMTC_VolumeDown() { SMTC_CtxVolumeDown(DefaultContext()); }
+SMTC_API void SMTC_SetVolume(float volume) { SMTC_CtxSetVolume(DefaultContext(), volume); }
+SMTC_API void SMTC_FadeVolume(float volume, int durationMs) { SMTC_CtxFadeVolume(DefaultContext(), volume, durationMs); }
+#endif
+#if SMTC_FEATURE_MASTER_VOLUME
+SMTC_API void SMTC_SetSystemVolume(float volume) { SMTC_CtxSetSystemVolume(DefaultContext(), volume); }
+SMTC_API void SMTC_ChangeSystemVolume(float delta) { SMTC_CtxChangeSystemVolume(DefaultContext(), delta); }
+#endif
+
+
+SMTC_API int SMTC_GetTitle(char* buffer, int len) { return SMTC_CtxGetTitle(DefaultContext(), buffer, len); }
+SMTC_API int SMTC_GetArtist(char* buffer, int len) { return SMTC_CtxGetArtist(DefaultContext(), buffer, len); }
+SMTC_API bool SMTC_GetPlaybackStatus() { return SMTC_CtxGetPlaybackStatus(DefaultContext()); }
+SMTC_API void SMTC_GetTimeline(long long* position, long long* duration) { SMTC_CtxGetTimeline(DefaultContext(), position, duration); }
+#if SMTC_FEATURE_COVER
+SMTC_API int SMTC_GetCoverImage(uint8_t* buffer, int len) { return SMTC_CtxGetCoverImage(DefaultContext(), buffer, len); }
+SMTC_API void SMTC_SetCoverLimit(unsigned int maxCoverBytes) { SMTC_CtxSetCoverLimit(DefaultContext(), maxCoverBytes); }
+SMTC_API void SMTC_SetSuspended(bool suspended) { SMTC_CtxSetSuspended(DefaultContext(), suspended); }
+#endif
+SMTC_API void SMTC_SetMemoryBudget(unsigned long long budgetBytes) { SMTC_CtxSetMemoryBudget(DefaultContext(), budgetBytes); }
+SMTC_API void SMTC_GetMemoryUsage(SMTC_MemoryUsage* usage) { SMTC_CtxGetMemoryUsage(DefaultContext(), usage); }
+SMTC_API bool SMTC_StartServer(const wchar_t* pipeName) { return SMTC_CtxStartServer(DefaultContext(), pipeName); }
+SMTC_API void SMTC_StopServer() { SMTC_CtxStopServer(DefaultContext()); }
+SMTC_API uint64_t SMTC_GetMediaInfo(SMTC_MediaInfo* info, uint64_t sinceVersion) { return SMTC_CtxGetMediaInfo(DefaultContext(), info, sinceVersion); }
+
+SMTC_API void SMTC_GetStats(SMTC_Stats* stats) { SMTC_CtxGetStats(DefaultContext(), stats); }
+SMTC_API void SMTC_ResetStats() { SMTC_CtxResetStats(DefaultContext()); }
@@ -0,0 +1,939 @@
+// SMTCBridgeStress.cpp  ʱѹ/ݲԣģŽӣβӳ١ڴͶиˮλ
+//
+// ÷SMTC-Bridge-Stress.exe [ÿ=10] [ģÿζȡӳٺ=0] [=1]
+// ʱÿֽһΣɶԱȸֵĹжǷڴ
+// Debug|x64 ÿ AddressSanitizerܿѹ·Խ硢ͷźʹõڴ
+// Linux Ͽ CMakeLists.txt SMTC_SANITIZE ѡ ASan+UBSan  TSanctest м̳ûܺ IPC
+//
+// ֱӰŽԴ DLLҪģע뵽ģSMTC_Context::backendڲӿڡ
+// üĹܣSMTC_FEATURE_*ͬ
+
+#include "../SMTC-Bridge-Cpp/SMTCBridge.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+// ================= ģ =================
+// ״̬ڴУиЧӦ¼ÿζȡע̶ӳ٣ģⲥӦ
+struct SimConfig {
+    std::atomic<int> readLatencyMs{ 0 };
+    std::atomic<uint32_t> coverBytes{ 256 * 1024 };
+    std::atomic<bool> ignoreCancel{ false }; // ģ޷жϵͬã GetTimelinePropertiesȡԵӳ
+
+    // δĶȡȡڵȴģڼִ;ޣȡ߳м
+    std::mutex readsMutex;
+    std::condition_variable readsCv;
+    int readsInFlight = 0;
+    int readsInFlightPeak = 0;
+    int readThreads = 0;
+
+    void BeginRead() {
+        std::lock_guard<std::mutex> lk(readsMutex);
+        readsInFlightPeak = std::max(readsInFlightPeak, ++readsInFlight);
+        ++readThreads;
+    }
+    // ڽ֮ǰã Worker һζȡص
+    void ReadDelivering() { std::lock_guard<std::mutex> lk(readsMutex); --readsInFlight; }
+    void EndRead() {
+        { std::lock_guard<std::mutex> lk(readsMutex); --readThreads; }
+        readsCv.notify_all();
+    }
+    // ȴжȡ֮߳̽øˮλ˳ǰҲҪ
+    void WaitForReads() {
+        std::unique_lock<std::mutex> lk(readsMutex);
+        readsCv.wait(lk, [this]() { return readThreads == 0; });
+    }
+    int ResetReadsPeak() { std::lock_guard<std::mutex> lk(readsMutex); return std::exchange(readsInFlightPeak, readsInFlight); }
+    int ReadsPeak() { std::lock_guard<std::mutex> lk(readsMutex); return readsInFlightPeak; }
+};
+
+// ڶ߳ϵȴעӳٺ󽻸 produce() Ľӳڼ䱻ȡǰĬֵ
+// ûӳʱڵ߳ͬ
+template <typename T, typename F>
+static AsyncRead<T> SimRead(const std::shared_ptr<SimConfig>& config, F produce) {
+    AsyncRead<T> read;
+    int ms = config->readLatencyMs.load();
+    if (ms <= 0) {
+        read.Complete(produce());
+        return read;
+    }
+
+    struct CancelFlag { std::mutex mutex; std::condition_variable cv; bool set = false; };
+    auto cancelled = std::make_shared<CancelFlag>();
+    if (!config->ignoreCancel.load()) {
+        read.OnCancel([cancelled]() {
+            { std::lock_guard<std::mutex> lk(cancelled->mutex); cancelled->set = true; }
+            cancelled->cv.notify_all();
+            });
+    }
+    config->BeginRead();
+    std::thread([config, read, cancelled, ms, produce = std::move(produce)]() {
+        bool wasCancelled;
+        {
+            std::unique_lock<std::mutex> lk(cancelled->mutex);
+            wasCancelled = cancelled->cv.wait_for(lk, std::chrono::milliseconds(ms), [&]() { return cancelled->set; });
+        }
+        T result = wasCancelled ? T{} : produce();
+        config->ReadDelivering();
+        read.Complete(std::move(result));
+        config->EndRead();
+        }).detach();
+    return read;
+}
+
+static std::string SimTitle(uint32_t track) { return "Track " + std::to_string(track); }
+
+#if SMTC_FEATURE_COVER
+struct SimThumbnail : IMediaThumbnail {
+    std::shared_ptr<SimConfig> config;
+    uint32_t track = 0;
+    uint32_t size = 0;
+
+    AsyncRead<std::optional<uint64_t>> Open() override {
+        return SimRead<std::optional<uint64_t>>(config, [size = size]() { return std::optional<uint64_t>(size); });
+    }
+    AsyncRead<std::optional<std::vector<uint8_t>>> Read() override {
+        return SimRead<std::optional<std::vector<uint8_t>>>(config, [track = track, size = size]() {
+            std::vector<uint8_t> out(size, static_cast<uint8_t>(track)); // ÿ׸ķݲͬϣ֮仯
+            if (size >= sizeof(track)) memcpy(out.data(), &track, sizeof(track));
+            return std::optional<std::vector<uint8_t>>(std::move(out));
+            });
+    }
+};
+#endif
+
+struct SimSession : IMediaSession, std::enable_shared_from_this<SimSession> {
+    std::shared_ptr<SimConfig> config;
+    std::wstring appId;
+    std::atomic<uint64_t> commands{ 0 };
+
+    std::mutex mutex; // ״̬
+    MediaSessionEvents events;
+    uint32_t track = 1;
+    bool playing = true;
+    int64_t positionTicks = 0;
+
+    SimSession(std::shared_ptr<SimConfig> cfg, std::wstring id) : config(std::move(cfg)), appId(std::move(id)) {}
+
+    std::wstring SourceAppId() override { return appId; }
+    void Subscribe(MediaSessionEvents handlers) override { std::lock_guard<std::mutex> lk(mutex); events = std::move(handlers); }
+    void Unsubscribe() override { std::lock_guard<std::mutex> lk(mutex); events = {}; }
+
+    // ȡڽʱȡʱ״̬ WinRT һܿȡ֮ı仯
+    AsyncRead<MediaPropertiesSnapshot> ReadMediaProperties() override {
+        return SimRead<MediaPropertiesSnapshot>(config, [self = shared_from_this()]() {
+            MediaPropertiesSnapshot read;
+            std::lock_guard<std::mutex> lk(self->mutex);
+            read.valid = true;
+            read.title = SimTitle(self->track);
+            read.artist = "Artist " + std::to_string(self->track % 7);
+            read.albumTitle = "Album " + std::to_string(self->track / 10);
+            read.albumArtist = read.artist;
+            read.genres = "Stress; Simulated";
+            read.trackNumber = static_cast<int32_t>(self->track % 10) + 1;
+            read.albumTrackCount = 10;
+#if SMTC_FEATURE_COVER
+            auto thumbnail = std::make_shared<SimThumbnail>();
+            thumbnail->config = self->config;
+            thumbnail->track = self->track;
+            thumbnail->size = self->config->coverBytes.load();
+            read.thumbnail = thumbnail;
+#endif
+            return read;
+            });
+    }
+
+    AsyncRead<TimelineSnapshot> ReadTimeline() override {
+        return SimRead<TimelineSnapshot>(config, [self = shared_from_this()]() {
+            TimelineSnapshot read;
+            std::lock_guard<std::mutex> lk(self->mutex);
+            read.valid = true;
+            read.positionTicks = self->positionTicks;
+            read.durationTicks = 180LL * 10000000LL;
+            return read;
+            });
+    }
+
+    AsyncRead<PlaybackSnapshot> ReadPlaybackInfo() override {
+        return SimRead<PlaybackSnapshot>(config, [self = shared_from_this()]() {
+            PlaybackSnapshot read;
+            std::lock_guard<std::mutex> lk(self->mutex);
+            read.valid = true;
+            read.isPlaying = self->playing;
+            read.status = self->playing ? 4 : 5; // GlobalSystemMediaTransportControlsSessionPlaybackStatus::Playing / Paused
+            read.type = 1;                       // MediaPlaybackType::Music
+            read.rate = 1.0;
+            read.shuffle = 0;
+            read.repeatMode = 0;
+            read.controls = SMTC_Control_Play | SMTC_Control_Pause | SMTC_Control_Next | SMTC_Control_Previous |
+                            SMTC_Control_PlayPauseToggle | SMTC_Control_PlaybackPosition;
+            return read;
+            });
+    }
+
+#if SMTC_FEATURE_CONTROLS
+    void SendCommand(MediaCommand command) override {
+        commands.fetch_add(1);
+        bool trackChanged = false;
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            switch (command) {
+            case MediaCommand::PlayPause: playing = !playing; break;
+            case MediaCommand::Play: playing = true; break;
+            case MediaCommand::Pause: playing = false; break;
+            case MediaCommand::Next: ++track; positionTicks = 0; trackChanged = true; break;
+            case MediaCommand::Previous: if (track > 1) --track; positionTicks = 0; trackChanged = true; break;
+            }
+        }
+        if (trackChanged) {
+            Raise(&MediaSessionEvents::mediaPropertiesChanged);
+            Raise(&MediaSessionEvents::timelineChanged);
+        }
+        else {
+            Raise(&MediaSessionEvents::playbackInfoChanged);
+        }
+    }
+    void ChangePosition(int64_t ticks) override {
+        commands.fetch_add(1);
+        { std::lock_guard<std::mutex> lk(mutex); positionTicks = ticks; }
+        Raise(&MediaSessionEvents::timelineChanged);
+    }
+#endif
+
+    // ģⲥи裺ʵһδýԡʱͲ״̬¼
+    void ChangeTrack() {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            ++track;
+            positionTicks = 0;
+            playing = true;
+        }
+        Raise(&MediaSessionEvents::mediaPropertiesChanged);
+        Raise(&MediaSessionEvents::timelineChanged);
+        Raise(&MediaSessionEvents::playbackInfoChanged);
+    }
+
+    // иͬʱл/ͣλã¼һ𵽴ÿȡõֵ
+    void ChangeTrackAndState() {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            ++track;
+            positionTicks = (track % 2) ? 0 : 30LL * 10000000LL;
+            playing = !playing;
+        }
+        Raise(&MediaSessionEvents::mediaPropertiesChanged);
+        Raise(&MediaSessionEvents::timelineChanged);
+        Raise(&MediaSessionEvents::playbackInfoChanged);
+    }
+
+    void AdvancePosition(int64_t ticks) {
+        { std::lock_guard<std::mutex> lk(mutex); positionTicks += ticks; }
+        Raise(&MediaSessionEvents::timelineChanged);
+    }
+
+    uint32_t CurrentTrack() { std::lock_guard<std::mutex> lk(mutex); return track; }
+
+    // ã WinRT һܺ Unsubscribe 
+    void Raise(std::function<void()> MediaSessionEvents::* which) {
+        std::function<void()> handler;
+        { std::lock_guard<std::mutex> lk(mutex); handler = events.*which; }
+        if (handler) handler();
+    }
+};
+
+struct SimBackend : IMediaBackend {
+    std::shared_ptr<SimConfig> config;
+    std::shared_ptr<SimSession> sessions[2];
+    std::atomic<uint64_t> starts{ 0 };
+
+    std::mutex mutex; //  sessionChanged / current
+    std::function<void()> sessionChanged;
+    int current = 0;
+
+    explicit SimBackend(std::shared_ptr<SimConfig> cfg) : config(std::move(cfg)) {
+        // appId Ӧκʵ̣ƵỰöٵҲƥ
+        sessions[0] = std::make_shared<SimSession>(config, L"SMTCBridgeStress.SimulatedPlayerA");
+        sessions[1] = std::make_shared<SimSession>(config, L"SMTCBridgeStress.SimulatedPlayerB");
+    }
+
+    //  WinRT ʵһڵȴڼѯ shouldStop
+    bool Start(const std::function<bool()>& shouldStop) override {
+        auto deadline = TimerClock::now() + std::chrono::milliseconds(config->readLatencyMs.load());
+        while (TimerClock::now() < deadline && !shouldStop()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        starts.fetch_add(1);
+        return !shouldStop();
+    }
+    void Stop() override { std::lock_guard<std::mutex> lk(mutex); sessionChanged = nullptr; }
+    void SubscribeSessionChanged(std::function<void()> handler) override { std::lock_guard<std::mutex> lk(mutex); sessionChanged = std::move(handler); }
+    std::shared_ptr<IMediaSession> PickSession() override { return Current(); }
+
+    std::shared_ptr<SimSession> Current() { std::lock_guard<std::mutex> lk(mutex); return sessions[current]; }
+
+    // ģûлһ
+    void SwitchSession() {
+        std::function<void()> handler;
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            current ^= 1;
+            handler = sessionChanged;
+        }
+        if (handler) handler();
+    }
+};
+
+// ================= 뱨 =================
+struct StressOptions {
+    std::chrono::seconds duration{ 10 };
+    int rounds = 1;
+};
+
+static uint64_t ProcessWorkingSet(uint64_t* peak = nullptr) {
+    uint64_t workingSet = 0, peakWorkingSet = 0;
+    if (!QueryProcessMemory(workingSet, peakWorkingSet)) return 0;
+    if (peak) *peak = peakWorkingSet;
+    return workingSet;
+}
+
+static double ToMB(uint64_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); }
+
+static void PrintLatency(const char* name, const SMTC_LatencyStats& s) {
+    printf("  %-14s n=%-10llu p50=%-8u p99=%-8u p99.9=%-8u max=%u us\n", name,
+           static_cast<unsigned long long>(s.count), s.p50Us, s.p99Us, s.p999Us, s.maxUs);
+}
+
+static void PrintStats(const char* scenario, SMTC_Context* ctx, uint64_t startWorkingSet) {
+    SMTC_Stats stats{};
+    SMTC_CtxGetStats(ctx, &stats);
+    printf("[%s]\n", scenario);
+    PrintLatency("getter", stats.getterLatency);
+    PrintLatency("event", stats.eventLatency);
+    PrintLatency("callback", stats.callbackDuration);
+    PrintLatency("queue wait", stats.queueLatency);
+    PrintLatency("task", stats.taskDuration);
+    printf("  tasks=%llu timers=%llu queue high-water=%u\n",
+           static_cast<unsigned long long>(stats.tasksExecuted), static_cast<unsigned long long>(stats.timersFired), stats.queueHighWater);
+    printf("  working set: start=%.1f MB steady=%.1f MB peak=%.1f MB cover=%.1f MB\n",
+           ToMB(startWorkingSet), ToMB(stats.workingSetBytes), ToMB(stats.peakWorkingSetBytes), ToMB(stats.coverBytes));
+}
+
+static void SMTC_CALL CountEvent(SMTC_Context*, SMTC_EventType, void* userData) {
+    static_cast<std::atomic<uint64_t>*>(userData)->fetch_add(1);
+}
+
+// ģһģص StopContext ʱÿע
+static std::shared_ptr<SMTC_Context> StartSimContext(const std::shared_ptr<SimBackend>& backend, std::atomic<uint64_t>* eventCounter,
+                                                     size_t maxBackendOps = kDefaultMaxBackendOps) {
+    auto ctx = std::make_shared<SMTC_Context>();
+    ctx->backend = backend;
+    ctx->maxBackendOps = maxBackendOps;
+    StartContext(ctx.get());
+    if (eventCounter) SMTC_CtxRegisterCallback(ctx.get(), &CountEvent, eventCounter);
+    return ctx;
+}
+
+// ȴŽ׷ģ˵ĵǰĿʱ false
+// ʣ Next Իúи裬ÿζȡֵ
+static bool WaitForTrack(SMTC_Context* ctx, SimSession& session, std::chrono::milliseconds timeout) {
+    auto deadline = TimerClock::now() + timeout;
+    char title[256];
+    while (TimerClock::now() < deadline) {
+        std::string expected = SimTitle(session.CurrentTrack());
+        int n = SMTC_CtxGetTitle(ctx, title, sizeof(title));
+        if (std::string(title, n) == expected) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+}
+
+// ================= IPC Ŀͻ =================
+// ⲿĽ̵Ӷķ񣺰Эյ״̬֡֡
+struct IpcTestFrame {
+    uint8_t type = 0;
+    uint64_t version = 0;
+    uint64_t mask = 0;
+    std::string title;
+    uint64_t coverHash = 0;
+};
+
+struct IpcTestClient {
+#if SMTC_PLATFORM_WINDOWS
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    std::vector<uint8_t> received;
+    bool malformed = false;
+
+    ~IpcTestClient() {
+#if SMTC_PLATFORM_WINDOWS
+        if (pipe != INVALID_HANDLE_VALUE) CloseHandle(pipe);
+#else
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool Connect(const std::wstring& name) {
+#if SMTC_PLATFORM_WINDOWS
+        pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        return pipe != INVALID_HANDLE_VALUE;
+#else
+        std::string path = WideToUtf8(name);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) return false;
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        return fd >= 0 && connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+#endif
+    }
+
+    bool SendCommand(uint8_t command) {
+        const uint8_t frame[6] = { 2, 0, 0, 0, IpcFrame_Command, command };
+#if SMTC_PLATFORM_WINDOWS
+        DWORD written = 0;
+        return WriteFile(pipe, frame, sizeof(frame), &written, nullptr) && written == sizeof(frame);
+#else
+        return send(fd, frame, sizeof(frame), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(frame));
+#endif
+    }
+
+    // ȴ timeoutȡѵݣضֽ0 ʾʱ-1 ʾӶϿ
+    int Receive(std::chrono::milliseconds timeout) {
+        uint8_t buf[64 * 1024];
+#if SMTC_PLATFORM_WINDOWS
+        auto deadline = TimerClock::now() + timeout;
+        for (;;) {
+            DWORD available = 0;
+            if (!PeekNamedPipe(pipe, nullptr, 0, nullptr, &available, nullptr)) return -1;
+            if (available) {
+                DWORD n = 0;
+                if (!ReadFile(pipe, buf, std::min<DWORD>(available, sizeof(buf)), &n, nullptr)) return -1;
+                received.insert(received.end(), buf, buf + n);
+                return static_cast<int>(n);
+            }
+            if (TimerClock::now() >= deadline) return 0;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+#else
+        pollfd p = { fd, POLLIN, 0 };
+        int r = poll(&p, 1, static_cast<int>(timeout.count()));
+        if (r < 0) return errno == EINTR ? 0 : -1;
+        if (r == 0) return 0;
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return -1;
+        received.insert(received.end(), buf, buf + n);
+        return static_cast<int>(n);
+#endif
+    }
+
+    // ѽյȡһ֡״̬֡ʽʱ malformed
+    bool PopFrame(IpcTestFrame& frame) {
+        if (malformed || received.size() < 4) return false;
+        uint32_t len = 0;
+        memcpy(&len, received.data(), sizeof(len));
+        if (received.size() - 4 < len) return false;
+
+        const uint8_t* p = received.data() + 4;
+        const uint8_t* end = p + len;
+        auto take = [&](void* out, size_t n) {
+            if (static_cast<size_t>(end - p) < n) { malformed = true; return; }
+            if (out) memcpy(out, p, n);
+            p += n;
+        };
+        frame = IpcTestFrame{};
+        take(&frame.type, sizeof(frame.type));
+        take(&frame.version, sizeof(frame.version));
+        take(&frame.mask, sizeof(frame.mask));
+        for (int i = 0; i < SMTC_FieldCount && !malformed; i++) {
+            if (!(frame.mask & (1ULL << i))) continue;
+            switch (static_cast<SMTC_Field>(i)) {
+            case SMTC_Field_Title:
+            case SMTC_Field_Artist:
+            case SMTC_Field_AlbumTitle:
+            case SMTC_Field_AlbumArtist:
+            case SMTC_Field_Genres: {
+                uint16_t n = 0;
+                take(&n, sizeof(n));
+                std::string text(n, '\0');
+                take(text.data(), n);
+                if (i == SMTC_Field_Title) frame.title = std::move(text);
+                break;
+            }
+            case SMTC_Field_PlaybackRate:
+            case SMTC_Field_Position:
+            case SMTC_Field_Duration:
+                take(nullptr, 8);
+                break;
+            case SMTC_Field_Cover: {
+                uint32_t size = 0;
+                take(&frame.coverHash, sizeof(frame.coverHash));
+                take(&size, sizeof(size));
+                take(nullptr, size);
+                break;
+            }
+            default:
+                take(nullptr, 4);
+                break;
+            }
+        }
+        if (p != end) malformed = true;
+        if (malformed) return false;
+        received.erase(received.begin(), received.begin() + 4 + len);
+        return true;
+    }
+};
+
+// =================  =================
+// /ֹͣʹöĺ;ɵĬĽӿڣֹͣʱСȡлʱ
+static bool RunInitShutdownCycles(const StressOptions& options, const std::shared_ptr<SimBackend>& backend) {
+    uint64_t startWorkingSet = ProcessWorkingSet();
+    LatencyHistogram stopLatency;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> pause(0, 5);
+    DefaultContext()->backend = backend;
+
+    uint64_t cycles = 0;
+    auto deadline = TimerClock::now() + options.duration;
+    while (TimerClock::now() < deadline) {
+        bool useDefault = (cycles % 2) == 1;
+        std::shared_ptr<SMTC_Context> ctx;
+        if (useDefault) InitSMTC();
+        else ctx = StartSimContext(backend, nullptr);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(pause(rng)));
+        if (cycles % 3 == 0) backend->Current()->ChangeTrack();
+
+        auto stopStart = TimerClock::now();
+        if (useDefault) ShutdownSMTC();
+        else StopContext(ctx.get());
+        stopLatency.Record(TimerClock::now() - stopStart);
+        ++cycles;
+    }
+
+    SMTC_LatencyStats stop{};
+    stopLatency.Snapshot(stop);
+    uint64_t peak = 0;
+    uint64_t endWorkingSet = ProcessWorkingSet(&peak);
+    printf("[init/shutdown cycles]\n  cycles=%llu\n", static_cast<unsigned long long>(cycles));
+    PrintLatency("stop", stop);
+    printf("  working set: start=%.1f MB end=%.1f MB peak=%.1f MB\n", ToMB(startWorkingSet), ToMB(endWorkingSet), ToMB(peak));
+    return true;
+}
+
+// ̲߳ȡͬʱģ˸Ƶи
+static bool RunConcurrentGetters(const StressOptions& options, const std::shared_ptr<SimBackend>& backend) {
+    uint64_t startWorkingSet = ProcessWorkingSet();
+    std::atomic<uint64_t> events{ 0 };
+    auto ctx = StartSimContext(backend, &events);
+    std::atomic<bool> stop{ false };
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 8; i++) {
+        readers.emplace_back([&stop, raw = ctx.get()]() {
+            char text[256];
+            long long position = 0, duration = 0;
+            SMTC_MediaInfo info{};
+            uint64_t version = 0;
+#if SMTC_FEATURE_COVER
+            std::vector<uint8_t> cover(4 * 1024 * 1024);
+#endif
+            while (!stop.load()) {
+                SMTC_CtxGetTitle(raw, text, sizeof(text));
+                SMTC_CtxGetArtist(raw, text, sizeof(text));
+                SMTC_CtxGetPlaybackStatus(raw);
+                SMTC_CtxGetTimeline(raw, &position, &duration);
+                SMTC_CtxGetMediaInfo(raw, &info, version);
+                version = info.version;
+#if SMTC_FEATURE_COVER
+                SMTC_CtxGetCoverImage(raw, cover.data(), static_cast<int>(cover.size()));
+#endif
+            }
+            });
+    }
+
+    auto deadline = TimerClock::now() + options.duration;
+    while (TimerClock::now() < deadline) {
+        backend->Current()->ChangeTrack();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    stop.store(true);
+    for (auto& t : readers) t.join();
+
+    bool converged = WaitForTrack(ctx.get(), *backend->Current(), std::chrono::seconds(5));
+    PrintStats("concurrent getters", ctx.get(), startWorkingSet);
+    printf("  callbacks=%llu final state %s\n", static_cast<unsigned long long>(events.load()), converged ? "OK" : "MISMATCH");
+    StopContext(ctx.get());
+    return converged;
+}
+
+// ߳ˢ۲Ƿʧ
+static bool RunCommandFlood(const StressOptions& options, const std::shared_ptr<SimBackend>& backend) {
+    uint64_t startWorkingSet = ProcessWorkingSet();
+    auto ctx = StartSimContext(backend, nullptr);
+    std::atomic<bool> stop{ false };
+    uint64_t commandsBefore = backend->Current()->commands.load();
+
+    std::vector<std::thread> senders;
+    for (int i = 0; i < 4; i++) {
+        senders.emplace_back([&stop, i, raw = ctx.get()]() {
+            uint64_t n = 0;
+            while (!stop.load()) {
+                switch ((n++ + i) % 6) {
+#if SMTC_FEATURE_CONTROLS
+                case 0: SMTC_CtxPlayPause(raw); break;
+                case 1: SMTC_CtxNext(raw); break;
+                case 2: SMTC_CtxSetTimeline(raw, static_cast<long long>(n) * 10000); break;
+#endif
+#if SMTC_FEATURE_SESSION_VOLUME
+                // ÿζҪöƵỰͬһ lane ִУŶӵĲ
+                case 3: SMTC_CtxVolumeUp(raw); std::this_thread::sleep_for(std::chrono::milliseconds(1)); break;
+                case 4: SMTC_CtxFadeVolume(raw, 0.5f, 100); std::this_thread::sleep_for(std::chrono::milliseconds(1)); break;
+#endif
+                default: std::this_thread::yield(); break;
+                }
+            }
+            });
+    }
+    std::this_thread::sleep_for(options.duration);
+    stop.store(true);
+    for (auto& t : senders) t.join();
+
+    // ѹ sanitizer ſҪ໨Щʱ
+    bool converged = WaitForTrack(ctx.get(), *backend->Current(), std::chrono::seconds(30));
+    PrintStats("command flood", ctx.get(), startWorkingSet);
+    printf("  commands reaching backend=%llu final state %s\n",
+           static_cast<unsigned long long>(backend->Current()->commands.load() - commandsBefore), converged ? "OK" : "MISMATCH");
+    StopContext(ctx.get());
+    return converged;
+}
+
+// Ƶи +  + леڴԤ
+static bool RunTrackChanges(const StressOptions& options, const std::shared_ptr<SimBackend>& backend, std::shared_ptr<SimConfig> config) {
+    uint64_t startWorkingSet = ProcessWorkingSet();
+    uint32_t savedCoverBytes = config->coverBytes.exchange(4 * 1024 * 1024);
+    std::atomic<uint64_t> events{ 0 };
+    auto ctx = StartSimContext(backend, &events);
+
+    uint64_t changes = 0;
+    auto deadline = TimerClock::now() + options.duration;
+    while (TimerClock::now() < deadline) {
+        backend->Current()->ChangeTrack();
+        backend->Current()->AdvancePosition(10000000);
+        if (++changes % 500 == 0) backend->SwitchSession();
+        if (changes % 2000 == 0) SMTC_CtxSetMemoryBudget(ctx.get(), (changes / 2000) % 2 ? 2 * 1024 * 1024 : 0);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    SMTC_CtxSetMemoryBudget(ctx.get(), 0);
+
+    bool converged = WaitForTrack(ctx.get(), *backend->Current(), std::chrono::seconds(10));
+    PrintStats("track changes", ctx.get(), startWorkingSet);
+    printf("  track changes=%llu callbacks=%llu final state %s\n",
+           static_cast<unsigned long long>(changes), static_cast<unsigned long long>(events.load()), converged ? "OK" : "MISMATCH");
+    StopContext(ctx.get());
+    config->coverBytes.store(savedCoverBytes);
+    return converged;
+}
+
+// ƵлҶȡ޷жϣ session ĶȡȡҪӳٲŷء
+// δصĶȡ¾ session ϼƣʼղ;ޣֹͣл׷ϵǰĿ
+static bool RunSessionSwitches(const StressOptions& options, const std::shared_ptr<SimBackend>& backend, std::shared_ptr<SimConfig> config) {
+    int savedLatency = config->readLatencyMs.load();
+    if (savedLatency == 0) config->readLatencyMs.store(20);
+    config->ignoreCancel.store(true);
+    config->WaitForReads();
+    config->ResetReadsPeak();
+
+    auto ctx = StartSimContext(backend, nullptr);
+    uint64_t switches = 0;
+    auto deadline = TimerClock::now() + options.duration;
+    while (TimerClock::now() < deadline) {
+        backend->SwitchSession();
+        backend->Current()->ChangeTrack();
+        ++switches;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    bool converged = WaitForTrack(ctx.get(), *backend->Current(), std::chrono::seconds(10));
+    StopContext(ctx.get());
+    config->WaitForReads();
+    int peak = config->ReadsPeak();
+
+    bool withinCap = peak <= static_cast<int>(ctx->maxBackendOps);
+    printf("[session switches, %d ms uninterruptible reads]\n", config->readLatencyMs.load());
+    printf("  switches=%llu backend reads in flight peak=%d cap=%zu %s, final state %s\n", static_cast<unsigned long long>(switches),
+           peak, ctx->maxBackendOps, withinCap ? "OK" : "EXCEEDED", converged ? "OK" : "MISMATCH");
+    config->ignoreCancel.store(false);
+    config->readLatencyMs.store(savedLatency);
+    return withinCap && converged;
+}
+
+// ضĿͻˣһ֡ǿգֻ֮ڹϣ仯ʱطͻ˷Ч
+// ͻڼȫѹ޺ӦΪյĿգͬһ汾ĿֻһΣпͻ˶׷ϵǰĿ
+// ںܽڴԤһͻˣղ棬ռòԤ
+struct IpcSubscriber {
+    IpcTestClient client;
+    bool slow = false;
+    uint64_t snapshotMask = kAvailableFieldMask;
+    bool ok = true;
+    uint64_t frames = 0;
+    uint64_t snapshots = 0;
+    uint64_t coverUpdates = 0;
+    uint64_t version = 0;
+    uint64_t coverHash = 0;
+    std::string title;
+
+    void ProcessFrames() {
+        IpcTestFrame frame;
+        while (client.PopFrame(frame)) {
+            bool first = frames++ == 0;
+            if (frame.type == IpcFrame_Snapshot) {
+                ++snapshots;
+                ok &= frame.mask == snapshotMask;
+                ok &= first || slow; // üʱĿͻֻʱյ
+                ok &= first || frame.version > version;
+            }
+            else if (frame.type == IpcFrame_Delta) {
+                ok &= !first && frame.version > version;
+#if SMTC_FEATURE_COVER
+                bool coverChanged = (frame.mask & (1ULL << SMTC_Field_Cover)) != 0;
+                ok &= !coverChanged || frame.coverHash != coverHash; // еķµ
+                if (coverChanged) ++coverUpdates;
+#endif
+            }
+            else {
+                ok = false;
+            }
+            version = frame.version;
+            if (frame.mask & (1ULL << SMTC_Field_Title)) title = frame.title;
+#if SMTC_FEATURE_COVER
+            if (frame.mask & (1ULL << SMTC_Field_Cover)) coverHash = frame.coverHash;
+#endif
+        }
+        ok &= !client.malformed;
+    }
+
+    // ȡֱ֡ quiet ʱûݣӶϿ false
+    bool Drain(std::chrono::milliseconds quiet) {
+        for (;;) {
+            int n = client.Receive(quiet);
+            if (n < 0) return false;
+            if (n == 0) return true;
+            ProcessFrames();
+        }
+    }
+};
+
+static bool RunIpcClients(const StressOptions& options, const std::shared_ptr<SimBackend>& backend, std::shared_ptr<SimConfig> config) {
+    uint32_t savedCoverBytes = config->coverBytes.exchange(4 * 1024 * 1024);
+    auto ctx = StartSimContext(backend, nullptr);
+    auto session = backend->Current();
+    WaitForTrack(ctx.get(), *session, std::chrono::seconds(10));
+#if SMTC_PLATFORM_WINDOWS
+    std::wstring name = L"\\\\.\\pipe\\SMTCBridgeStress-" + std::to_wstring(GetCurrentProcessId());
+#else
+    std::wstring name = L"/tmp/SMTCBridgeStress-" + std::to_wstring(getpid()) + L".sock";
+#endif
+    printf("[ipc clients]\n");
+    bool ok = SMTC_CtxStartServer(ctx.get(), name.c_str());
+
+    IpcSubscriber subscribers[4];
+    subscribers[2].slow = true;
+    subscribers[3].slow = true;
+    for (auto& sub : subscribers) ok = ok && sub.client.Connect(name);
+
+    uint64_t changes = 0;
+    uint64_t commandsSent = 0;
+    uint64_t commandsBefore = session->commands.load();
+    auto deadline = TimerClock::now() + options.duration;
+    // и 10 ΣĿͻ˻ѹķ泬 kIpcMaxQueuedBytesȡӳٺٶ޹
+    while (ok && (TimerClock::now() < deadline || changes < 600)) {
+        // и裨ֱлɿͻ˵ Next УýԵķʱ䣬ÿζ·
+        if (changes % 60 == 0) session->ChangeTrack();
+        else session->AdvancePosition(10000000);
+#if SMTC_FEATURE_CONTROLS
+        if (changes % 60 == 30 && subscribers[0].client.SendCommand(SMTC_IpcCommand_Next)) ++commandsSent;
+#endif
+        ++changes;
+        for (auto& sub : subscribers) {
+            if (!sub.slow) ok &= sub.Drain(std::chrono::milliseconds(0));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    auto commandsDeadline = TimerClock::now() + std::chrono::seconds(10);
+    while (session->commands.load() - commandsBefore < commandsSent && TimerClock::now() < commandsDeadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    uint64_t commandsReceived = session->commands.load() - commandsBefore;
+    bool converged = WaitForTrack(ctx.get(), *session, std::chrono::seconds(10));
+    std::string expected = SimTitle(session->CurrentTrack());
+    uint64_t snapshots = 0;
+    for (auto& sub : subscribers) {
+        ok &= sub.Drain(std::chrono::milliseconds(1000));
+        bool caughtUp = sub.title == expected;
+        printf("  %s client: frames=%llu snapshots=%llu cover updates=%llu %s, %s\n", sub.slow ? "slow" : "fast",
+               static_cast<unsigned long long>(sub.frames), static_cast<unsigned long long>(sub.snapshots),
+               static_cast<unsigned long long>(sub.coverUpdates), sub.ok ? "frame order OK" : "BAD FRAMES", caughtUp ? "caught up" : "BEHIND");
+        ok &= sub.ok && caughtUp;
+#if SMTC_FEATURE_COVER
+        // Ŀͻ˱뾭ѹգûзʱѹֻ֡ƣǷȡٶȣҪ
+        ok &= !sub.slow || sub.snapshots >= 2;
+        ok &= sub.slow || sub.coverUpdates > 0;
+#endif
+        snapshots += sub.snapshots;
+    }
+    uint64_t encodes = 0;
+    {
+        std::shared_ptr<IpcServer> server;
+        { std::lock_guard<std::mutex> lk(ctx->serverMutex); server = ctx->server; }
+        std::lock_guard<std::mutex> lk(server->mutex);
+        encodes = server->snapshotEncodes;
+    }
+    // ʱĿͻ˵ĲնӦñ
+    printf("  snapshots received=%llu encoded=%llu %s\n", static_cast<unsigned long long>(snapshots),
+           static_cast<unsigned long long>(encodes), encodes < snapshots ? "shared" : "NOT SHARED");
+    ok &= encodes < snapshots;
+
+#if SMTC_FEATURE_COVER
+    // Ԥֻȵǰռö 1 MBֵÿͻ˵ĶԶСڷ
+    SMTC_MemoryUsage usage{};
+    SMTC_CtxGetMemoryUsage(ctx.get(), &usage);
+    uint64_t budget = usage.totalBytes + 1024 * 1024;
+    SMTC_CtxSetMemoryBudget(ctx.get(), budget);
+    IpcSubscriber late;
+    late.snapshotMask = kAvailableFieldMask & ~(1ULL << SMTC_Field_Cover);
+    ok &= late.client.Connect(name) && late.Drain(std::chrono::milliseconds(500));
+    SMTC_CtxGetMemoryUsage(ctx.get(), &usage);
+    bool withinBudget = usage.totalBytes <= budget;
+    printf("  client under %llu KB budget: snapshot without cover %s, held %llu KB %s\n", static_cast<unsigned long long>(budget / 1024),
+           late.ok && late.snapshots == 1 ? "OK" : "BAD FRAMES", static_cast<unsigned long long>(usage.totalBytes / 1024), withinBudget ? "OK" : "OVER BUDGET");
+    ok &= late.ok && late.snapshots == 1 && late.title == expected && withinBudget;
+    SMTC_CtxSetMemoryBudget(ctx.get(), 0);
+#endif
+    printf("  changes=%llu commands sent=%llu reached backend=%llu final state %s\n", static_cast<unsigned long long>(changes),
+           static_cast<unsigned long long>(commandsSent), static_cast<unsigned long long>(commandsReceived), converged ? "OK" : "MISMATCH");
+    ok &= converged && commandsReceived == commandsSent;
+
+    SMTC_CtxStopServer(ctx.get());
+    StopContext(ctx.get());
+    config->coverBytes.store(savedCoverBytes);
+    return ok;
+}
+
+// עȡӳ٣ԱȲͬ;µ¼Ͷӳ٣1 ΪȫУlane ൱ڲޡ
+// ÿα仯ͬʱȡ㹻һεĶȡȫɣǵα仯Ͷӳٶǻѹ
+static bool RunConcurrencyComparison(const StressOptions& options, const std::shared_ptr<SimBackend>& backend, std::shared_ptr<SimConfig> config) {
+    int savedLatency = config->readLatencyMs.load();
+    if (savedLatency == 0) config->readLatencyMs.store(20); // ûӳʱᱻû
+    int latencyMs = config->readLatencyMs.load();
+    printf("[concurrency, %d ms read latency]\n", latencyMs);
+
+    bool ok = true;
+    const size_t caps[] = { 1, kDefaultMaxBackendOps, static_cast<size_t>(OpLane::Count) };
+    for (size_t cap : caps) {
+        auto ctx = StartSimContext(backend, nullptr, cap);
+        WaitForTrack(ctx.get(), *backend->Current(), std::chrono::seconds(10));
+        SMTC_CtxResetStats(ctx.get()); // ʱ״ζȡ
+
+        uint64_t changes = 0;
+        auto deadline = TimerClock::now() + options.duration;
+        while (TimerClock::now() < deadline) {
+            backend->Current()->ChangeTrackAndState();
+            ++changes;
+            std::this_thread::sleep_for(kMediaPropertiesDebounce + std::chrono::milliseconds(latencyMs * 8));
+        }
+        bool converged = WaitForTrack(ctx.get(), *backend->Current(), std::chrono::seconds(10));
+
+        SMTC_Stats stats{};
+        SMTC_CtxGetStats(ctx.get(), &stats);
+        char label[32];
+        snprintf(label, sizeof(label), "event cap=%zu", cap);
+        PrintLatency(label, stats.eventLatency);
+        printf("  track changes=%llu final state %s\n", static_cast<unsigned long long>(changes), converged ? "OK" : "MISMATCH");
+        StopContext(ctx.get());
+        ok &= converged;
+    }
+    config->readLatencyMs.store(savedLatency);
+    return ok;
+}
+
+// /ֹͣʱÿ½ģ⣨Լ棩ʱֹͣʱȡλ
+// ڱȽϲͬϵĹ measure-features.shȷָ
+static double MedianMs(std::vector<double> values) {
+    if (values.empty()) return -1;
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) / 2];
+}
+
+static bool RunStartupTiming(int runs, const std::shared_ptr<SimBackend>& backend, std::shared_ptr<SimConfig> config) {
+    using Ms = std::chrono::duration<double, std::milli>;
+    std::vector<double> firstTitle, coverReady, stop;
+    bool ok = true;
+    auto info = std::make_unique<SMTC_MediaInfo>();
+    for (int run = 0; run < runs; run++) {
+        backend->Current()->ChangeTrack(); // ÿζĿ·棬һεӰ
+        auto start = TimerClock::now();
+        auto ctx = StartSimContext(backend, nullptr);
+        auto deadline = start + std::chrono::seconds(5);
+        bool gotTitle = false, gotCover = !SMTC_FEATURE_COVER;
+        while ((!gotTitle || !gotCover) && TimerClock::now() < deadline) {
+            SMTC_CtxGetMediaInfo(ctx.get(), info.get(), 0);
+            if (!gotTitle && info->title[0]) { gotTitle = true; firstTitle.push_back(Ms(TimerClock::now() - start).count()); }
+            if (!gotCover && info->coverSize) { gotCover = true; coverReady.push_back(Ms(TimerClock::now() - start).count()); }
+            std::this_thread::yield();
+        }
+        ok &= gotTitle && gotCover;
+
+        auto stopStart = TimerClock::now();
+        StopContext(ctx.get());
+        stop.push_back(Ms(TimerClock::now() - stopStart).count());
+        config->WaitForReads();
+    }
+    printf("[startup, %d runs, %d ms simulated read latency]\n", runs, config->readLatencyMs.load());
+    printf("  first title median=%.3f ms\n", MedianMs(firstTitle));
+#if SMTC_FEATURE_COVER
+    printf("  cover ready median=%.3f ms\n", MedianMs(coverReady));
+#endif
+    printf("  stop        median=%.3f ms\n", MedianMs(stop));
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    StressOptions options;
+    auto config = std::make_shared<SimConfig>();
+    if (argc > 1 && strcmp(argv[1], "startup") == 0) {
+        // startup [=50] [ģȡӳٺ=0]
+        int runs = argc > 2 ? std::max(1, atoi(argv[2])) : 50;
+        if (argc > 3) config->readLatencyMs.store(std::max(0, atoi(argv[3])));
+        auto backend = std::make_shared<SimBackend>(config);
+        printf("features=0x%X\n", SMTC_GetFeatures());
+        bool ok = RunStartupTiming(runs, backend, config);
+        config->WaitForReads();
+        printf("%s\n", ok ? "PASS" : "FAIL");
+        return ok ? 0 : 1;
+    }
+    if (argc > 1) options.duration = std::chrono::seconds(std::max(1, atoi(argv[1])));
+    if (argc > 2) config->readLatencyMs.store(std::max(0, atoi(argv[2])));
+    if (argc > 3) options.rounds = std::max(1, atoi(argv[3]));
+    auto backend = std::make_shared<SimBackend>(config);
+
+    printf("SMTC bridge stress: %llds per scenario, %d ms simulated read latency, %d round(s), features=0x%X\n",
+           static_cast<long long>(options.duration.count()), config->readLatencyMs.load(), options.rounds, SMTC_GetFeatures());
+
+    bool ok = true;
+    for (int round = 1; round <= options.rounds; round++) {
+        printf("=== round %d ===\n", round);
+        ok &= RunInitShutdownCycles(options, backend);
+        ok &= RunConcurrentGetters(options, backend);
+        ok &= RunCommandFlood(options, backend);
+        ok &= RunTrackChanges(options, backend, config);
+        ok &= RunSessionSwitches(options, backend, config);
+        ok &= RunIpcClients(options, backend, config);
+        ok &= RunConcurrencyComparison(options, backend, config);
+        fflush(stdout);
+    }
+    config->WaitForReads();
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
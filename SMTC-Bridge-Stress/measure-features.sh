@@ -0,0 +1,39 @@
+#!/bin/sh
+# measure-features.sh：在 Linux 上按功能组合分别编译，用模拟后端报告核心代码大小与启动/停止耗时
+#
+#   sh SMTC-Bridge-Stress/measure-features.sh [次数=50] [模拟读取延迟毫秒=0] [输出目录=/tmp/smtc-feature-builds]
+#
+# Linux 上的核心不含 WinRT 后端和音量功能，所以只比较 COVER 与 CONTROLS 的四种组合；
+# Windows DLL 的比较见 SMTC-Bridge-Cpp/Measure-Features.ps1。
+#   core KB     单独编译 SMTCBridge.cpp（-O2）得到的目标文件 text 段大小
+#   first title 新建上下文到读到标题的耗时（压力测试的 startup 模式），取中位数
+#   cover       新建上下文到读到封面的耗时，COVER=0 时为 -
+#   stop        停止上下文的耗时
+set -eu
+
+runs=${1:-50}
+latency=${2:-0}
+out=${3:-/tmp/smtc-feature-builds}
+here=$(cd "$(dirname "$0")" && pwd)
+cxx=${CXX:-c++}
+
+printf '%-12s %8s %16s %10s %9s\n' build 'core KB' 'first title ms' 'cover ms' 'stop ms'
+for combo in "all-on 1 1" "no-cover 0 1" "no-controls 1 0" "all-off 0 0"; do
+    set -- $combo
+    name=$1
+    defines="-DSMTC_FEATURE_COVER=$2 -DSMTC_FEATURE_CONTROLS=$3"
+    dir="$out/$name"
+    mkdir -p "$dir"
+
+    "$cxx" -std=c++20 -O2 -DNDEBUG $defines -c "$here/../SMTC-Bridge-Cpp/SMTCBridge.cpp" -o "$dir/core.o"
+    kb=$(size "$dir/core.o" | awk 'NR == 2 { printf "%.1f", $1 / 1024 }')
+
+    cmake -S "$here" -B "$dir/build" -DCMAKE_BUILD_TYPE=Release "-DCMAKE_CXX_FLAGS=$defines" >/dev/null
+    cmake --build "$dir/build" >/dev/null
+    result=$("$dir/build/smtc-bridge-stress" startup "$runs" "$latency")
+    first=$(printf '%s\n' "$result" | awk '/first title/ { sub("median=", "", $3); print $3 }')
+    cover=$(printf '%s\n' "$result" | awk '/cover ready/ { sub("median=", "", $3); print $3 }')
+    stop=$(printf '%s\n' "$result" | awk '/stop/ { sub("median=", "", $2); print $2 }')
+
+    printf '%-12s %8s %16s %10s %9s\n' "$name" "$kb" "$first" "${cover:--}" "$stop"
+done